@@ -2,6 +2,7 @@
 #define _APP_CONFIG_H_
 
 #include <cstdlib>
+#include <cstdint>
 
 /** Desired window width */
 #define WIDTH 800
@@ -11,4 +12,50 @@
 /** Image format used in the swapchain and image views */
 #define IMAGE_FORMAT VK_FORMAT_B8G8R8A8_SRGB
 
+/** Default number of frames the CPU may record ahead of the GPU */
+#define MAX_FRAMES_IN_FLIGHT 2
+
+/** File the pipeline cache is saved to between runs */
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin"
+
+/** Size of the memory blocks ValiumAllocator sub-allocates from */
+#define ALLOCATOR_BLOCK_SIZE (64ull * 1024 * 1024)
+
+/** Smallest sub-allocation ValiumAllocator hands out */
+#define ALLOCATOR_MIN_ALLOCATION 256ull
+
+/** Staging space per frame in flight for ValiumUploader, grown when a frame needs more */
+#define UPLOAD_STAGING_SIZE (4ull * 1024 * 1024)
+
+/** Uniform data per frame in flight in ValiumUniformRing */
+#define UNIFORM_RING_SIZE (1ull * 1024 * 1024)
+
+/** Sets in the first descriptor pool of ValiumDescriptorAllocator */
+#define DESCRIPTOR_POOL_SETS 64u
+
+/** Most sets in one descriptor pool, later pools double up to this */
+#define DESCRIPTOR_POOL_MAX_SETS 4096u
+
+/** Most sampled images in the bindless table, lowered to the device's limits */
+#define BINDLESS_MAX_IMAGES 16384u
+
+/** Most storage buffers in the bindless table, lowered to the device's limits */
+#define BINDLESS_MAX_BUFFERS 4096u
+
+/**
+ * Per stage resources left to the pipeline's other sets and color
+ * attachments when the bindless table is sized to maxPerStageUpdateAfterBindResources
+ */
+#define BINDLESS_RESERVED_RESOURCES 64u
+
+/** Descriptor set number the bindless table is bound at */
+#define BINDLESS_SET 1u
+
+/** Half the width of the grid drawn with ValiumOptions::indirectDraws, 1 fills the view */
+#define INDIRECT_GRID_EXTENT 1.5f
+
+/** Shader files loaded instead of the embedded shaders when hot reloading */
+#define VERT_SHADER_FILE "shaders/vert.spv"
+#define FRAG_SHADER_FILE "shaders/frag.spv"
+
 #endif
@@ -0,0 +1,41 @@
+#include "valium_reflection.h"
+#include "valium_embedded_shaders.h"
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+/**
+ * Maps the file extension baked into an embedded shader's name to its stage
+ */
+static VkShaderStageFlagBits ExpectedStage(const std::string& name) {
+  std::string extension = name.substr(name.rfind('_') + 1);
+  if (extension == "VERT") {
+    return VK_SHADER_STAGE_VERTEX_BIT;
+  }
+  if (extension == "FRAG") {
+    return VK_SHADER_STAGE_FRAGMENT_BIT;
+  }
+  if (extension == "COMP") {
+    return VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  return VK_SHADER_STAGE_ALL;
+}
+
+/**
+ * Reflects every embedded shader, exits non-zero if any can't be read
+ */
+int main() {
+  int failures = 0;
+  for (const ValiumEmbeddedShaders::Shader& shader : ValiumEmbeddedShaders::ALL) {
+    try {
+      ShaderReflection reflection = ValiumReflection::Reflect(shader.code, shader.size);
+      if (reflection.stage != ExpectedStage(shader.name)) {
+        throw std::runtime_error("reflected the wrong stage!");
+      }
+    } catch (const std::exception& e) {
+      std::cerr << shader.name << ": " << e.what() << std::endl;
+      failures++;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
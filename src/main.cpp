@@ -5,11 +5,18 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <memory>
+#include <cstring>
+#include <chrono>
 #include "window.h"
 #include "valium.h"
 
+/** Number of frames rendered by a headless run unless --frames is given */
+#define HEADLESS_FRAME_COUNT 1000
+
 class HelloTriangleApplication {
 public:
+  HelloTriangleApplication(const ValiumOptions& options, unsigned long frames) : _options(options), _frames(frames) {}
+
   void run() {
     initVulkan();
     mainLoop();
@@ -18,9 +25,12 @@ public:
 
 private:
   Valium* _valium;
-  
+  ValiumOptions _options;
+  /** Frames to render when headless */
+  unsigned long _frames;
+
   void initVulkan() {
-    _valium = new Valium("Vulkan");
+    _valium = new Valium("Vulkan", _options);
 #ifdef SHOW_AVAILABLE_EXTENSIONS
     std::vector<std::string> names = _valium->GetAvailableExtensions();
     std::cout << "available extensions:" << std::endl;
@@ -31,10 +41,33 @@ private:
   }
 
   void mainLoop() {
+    if (_valium->IsHeadless()) {
+      headlessLoop();
+      return;
+    }
+
     GLFWwindow* win = _valium->GetWindow();
     while (!glfwWindowShouldClose(win)) {
       glfwPollEvents();
+      _valium->DrawFrame();
     }
+    _valium->WaitIdle();
+  }
+
+  /**
+   * Renders a fixed number of frames as fast as the device allows and
+   * reports the throughput. There is no vsync or compositor to wait on.
+   */
+  void headlessLoop() {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < _frames; i++) {
+      _valium->DrawFrame();
+    }
+    _valium->WaitIdle();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Rendered " << _frames << " frames in " << elapsed.count() << "s ("
+              << _frames / elapsed.count() << " frames/s)" << std::endl;
   }
 
   void cleanup() {
@@ -42,8 +75,46 @@ private:
   }
 };
 
-int main() {
-    HelloTriangleApplication app;
+int main(int argc, char** argv) {
+    ValiumOptions options;
+    unsigned long frames = HEADLESS_FRAME_COUNT;
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--headless") == 0) {
+        options.headless = true;
+      } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+        frames = strtoul(argv[++i], nullptr, 10);
+      } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+        options.framesInFlight = strtoul(argv[++i], nullptr, 10);
+      } else if (strcmp(argv[i], "--hot-reload") == 0) {
+        options.hotReloadShaders = true;
+      } else if (strcmp(argv[i], "--mesh") == 0) {
+        options.drawMesh = true;
+      } else if (strcmp(argv[i], "--indirect") == 0 && i + 1 < argc) {
+        options.indirectDraws = strtoul(argv[++i], nullptr, 10);
+      } else if (strcmp(argv[i], "--bindless") == 0) {
+        options.bindless = true;
+      } else if (strcmp(argv[i], "--static") == 0) {
+        options.staticCommandBuffers = true;
+      } else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+        options.recordThreads = strtoul(argv[++i], nullptr, 10);
+      } else if (strcmp(argv[i], "--compile-threads") == 0 && i + 1 < argc) {
+        options.pipelineCompileThreads = strtoul(argv[++i], nullptr, 10);
+      } else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc) {
+        const char* policy = argv[++i];
+        if (strcmp(policy, "low-latency") == 0) {
+          options.presentPolicy = ValiumPresentPolicy::LowLatency;
+        } else if (strcmp(policy, "throughput") == 0) {
+          options.presentPolicy = ValiumPresentPolicy::MaxThroughput;
+        } else if (strcmp(policy, "power-saving") == 0) {
+          options.presentPolicy = ValiumPresentPolicy::PowerSaving;
+        } else {
+          std::cerr << "Unknown present policy " << policy << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+
+    HelloTriangleApplication app(options, frames);
 
     try {
         app.run();
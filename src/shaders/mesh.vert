@@ -0,0 +1,19 @@
+#version 450
+
+// Interleaved per vertex data from a ValiumBuffer, binding 0
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// Per draw placement, pushed with vkCmdPushConstants
+layout(push_constant) uniform Transform {
+  vec2 offset;
+  float scale;
+} transform;
+
+// Pass a color from each vertex on to the fragment shader
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+  gl_Position = vec4(inPosition * transform.scale + transform.offset, 0.0, 1.0);
+  fragColor = inColor;
+}
@@ -27,8 +27,12 @@ struct Valium::impl {
   std::vector<const char*> requestedExtensions;
   /** Surface for rendering to */
   VkSurfaceKHR surface = VK_NULL_HANDLE;
-  /** Window and its operations */
+  /** Window and its operations. Not created when running headless */
   std::unique_ptr<Window> window;
+  /** Options given at construction */
+  ValiumOptions options;
+  /** Set when the window was resized or the swapchain reported it is out of date */
+  bool swapchainOutOfDate = false;
 
   /** Creates the vulkan instance and assigns it to instance */
   void initVulkanInstance(const char* app_name);
@@ -36,7 +40,7 @@ struct Valium::impl {
   /** Checks the vulkan API for a list of available extensions */
   std::vector<VkExtensionProperties> getVulkanExtensions();
 
-  impl(const char* name) : app_name(name) {}
+  impl(const char* name, const ValiumOptions& options) : app_name(name), options(options) {}
 
   /**
    * @brief Applies instance extensions.
@@ -45,7 +49,7 @@ struct Valium::impl {
    * VK_KHR_portability_subset MUST be set (per the spec) if it is an available
    * extension, therefore VK_KHR_get_physical_device_properties2 must also be set.
    *
-   * This function also sets the extensions required by GLFW
+   * This function also sets the extensions required by GLFW, unless running headless
    *
    * This function may be extended to include other extensions.
    *
@@ -69,12 +73,19 @@ struct Valium::impl {
   void CreateWindow();
 };
 
-Valium::Valium(const char* app_name) {
-  _impl = new impl(app_name);
+Valium::Valium(const char* app_name, const ValiumOptions& options) {
+  if (options.framesInFlight == 0) {
+    throw std::runtime_error("at least one frame must be allowed in flight!");
+  }
+  _impl = new impl(app_name, options);
   _impl->inst = this;
-  _impl->CreateWindow();
+  if (!options.headless) {
+    _impl->CreateWindow();
+  }
   _impl->initVulkanInstance(app_name);
-  _impl->CreateSurface();
+  if (!options.headless) {
+    _impl->CreateSurface();
+  }
   _impl->selectDevice();
 }
 
@@ -105,9 +116,42 @@ std::vector<std::string> Valium::GetAvailableExtensions() {
 }
 
 GLFWwindow* Valium::GetWindow() {
+  if (!_impl->window) {
+    return nullptr;
+  }
   return _impl->window->GetWindow();
 }
 
+bool Valium::IsHeadless() {
+  return _impl->options.headless;
+}
+
+void Valium::DrawFrame() {
+  if (_impl->window && _impl->window->WasResized()) {
+    _impl->swapchainOutOfDate = true;
+  }
+
+  if (_impl->swapchainOutOfDate) {
+    int width, height;
+    glfwGetFramebufferSize(_impl->window->GetWindow(), &width, &height);
+    if (width == 0 || height == 0) {
+      // Minimized, there is nothing to render to until the window comes back
+      glfwWaitEvents();
+      return;
+    }
+    _impl->device->RecreateSwapchain(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    _impl->swapchainOutOfDate = false;
+  }
+
+  if (!_impl->device->DrawFrame()) {
+    _impl->swapchainOutOfDate = true;
+  }
+}
+
+void Valium::WaitIdle() {
+  _impl->device->WaitIdle();
+}
+
 void Valium::impl::initVulkanInstance(const char* app_name) {
   VkApplicationInfo appInfo{};
   appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -129,7 +173,7 @@ void Valium::impl::initVulkanInstance(const char* app_name) {
   // Update createInfo with desired extensions
   SetInstanceExtensions(createInfo);
 
-  if (verifyGlfwWorksWithVulkan() == false) {
+  if (!options.headless && verifyGlfwWorksWithVulkan() == false) {
      throw std::runtime_error("This Vulkan API does not support GLFW");
   }
   if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
@@ -156,11 +200,14 @@ void Valium::impl::SetInstanceExtensions(VkInstanceCreateInfo &info) {
     }
   }
 
-  // Push the GLFW extensions into the list
-  uint32_t glfwExtensionCount;
-  const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-  for (uint32_t i = 0; i < glfwExtensionCount; i++) {
-    requestedExtensions.push_back(glfwExtensions[i]);
+  // Push the GLFW extensions into the list. GLFW is never initialized
+  // when running headless, and there is no surface to need them.
+  if (!options.headless) {
+    uint32_t glfwExtensionCount;
+    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    for (uint32_t i = 0; i < glfwExtensionCount; i++) {
+      requestedExtensions.push_back(glfwExtensions[i]);
+    }
   }
 
 #ifdef SHOW_AVAILABLE_EXTENSIONS
@@ -232,11 +279,15 @@ void Valium::impl::selectDevice() {
   }
 
   // Now that a device has been selected, wrap it with some valium.
-  int width, height;
-  glfwGetFramebufferSize(window->GetWindow(), &width, &height);
-  device = new ValiumDevice(selectedDevice, surface,
+  int width = options.width;
+  int height = options.height;
+  if (!options.headless) {
+    glfwGetFramebufferSize(window->GetWindow(), &width, &height);
+  }
+  device = new ValiumDevice(instance, selectedDevice, surface,
                             static_cast<uint32_t>(width),
-                            static_cast<uint32_t>(height));
+                            static_cast<uint32_t>(height),
+                            options);
 }
 
 bool Valium::impl::isDeviceSuitable(VkPhysicalDevice device) {
@@ -247,17 +298,19 @@ bool Valium::impl::isDeviceSuitable(VkPhysicalDevice device) {
   std::cout << "Found device [" << device << "]: " << props.deviceName << std::endl;
 #endif
 
-  bool supportsRequiredExtensions = ValiumDevice::SupportsRequiredExtensions(device);
+  bool supportsRequiredExtensions = ValiumDevice::SupportsRequiredExtensions(device, surface);
 
   // Make sure there is at least one queue that supports graphics.
+  // When running headless the surface is VK_NULL_HANDLE and presenting is skipped.
   QueueFamilyIndices indices = ValiumQueue::GetQueueIndices(device, surface);
 
   // Make sure the swapchain with the device and surface can be used.
-  bool isSwapchainGood = ValiumSwapchain::SupportsDrawing(device, surface);
+  // There is no swapchain when running headless.
+  bool isSwapchainGood = surface == VK_NULL_HANDLE || ValiumSwapchain::SupportsDrawing(device, surface);
 
   // No particular features must be specified, but you could return false
   // if a certain feature isn't supported.
-  return indices.isComplete() && supportsRequiredExtensions && isSwapchainGood;
+  return indices.isComplete(surface) && supportsRequiredExtensions && isSwapchainGood;
 }
 
 void Valium::impl::CreateSurface() {
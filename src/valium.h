@@ -18,11 +18,18 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include "valium_options.h"
 
 class Valium
 {
  public:
-  Valium(const char* app_name);
+  /**
+   * Creates the vulkan instance and selects a device to render with
+   *
+   * @param[in] app_name Name of the application, used as the window title
+   * @param[in] options Construction options, see ValiumOptions
+   */
+  Valium(const char* app_name, const ValiumOptions& options = ValiumOptions());
   ~Valium();
 
   /**
@@ -31,9 +38,29 @@ class Valium
   std::vector<std::string> GetAvailableExtensions();
 
   /**
-   * Returns the GLFW window handle
+   * Returns the GLFW window handle, or nullptr when running headless
    */
   GLFWwindow* GetWindow();
+
+  /**
+   * Returns true if Valium was constructed without a window
+   */
+  bool IsHeadless();
+
+  /**
+   * Records, submits and presents one frame.
+   * See ValiumOptions::framesInFlight for how many frames may be queued.
+   *
+   * If the window was resized or the swapchain went out of date, the
+   * swapchain is rebuilt first. While the window is minimized this waits
+   * for window events instead of drawing.
+   */
+  void DrawFrame();
+
+  /**
+   * Blocks until the GPU has finished all submitted frames
+   */
+  void WaitIdle();
   
  private:
   struct impl;
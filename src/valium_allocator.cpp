@@ -0,0 +1,431 @@
+#include "valium_allocator.h"
+#include "app_config.h"
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/**
+ * One vkAllocateMemory call, split up with a buddy allocator.
+ *
+ * Ranges have sizes ALLOCATOR_MIN_ALLOCATION << order. A range of a given
+ * order always starts at a multiple of its size, and its buddy is the
+ * neighbour it was split from.
+ */
+struct ValiumMemoryBlock {
+  /** The memory object */
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+
+  /** Size of the block, ALLOCATOR_MIN_ALLOCATION << @a maxOrder */
+  VkDeviceSize size = 0;
+
+  /** Order of the whole block */
+  uint32_t maxOrder = 0;
+
+  /** Memory type of the block */
+  uint32_t memoryType = 0;
+
+  /** True if the block holds buffers and linear images */
+  bool linear = true;
+
+  /** Base of the mapping when host visible, otherwise nullptr */
+  void* mapped = nullptr;
+
+  /** Offsets of the free ranges of each order */
+  std::vector<std::set<VkDeviceSize>> freeLists;
+
+  /** Order of each allocated range, keyed by offset */
+  std::unordered_map<VkDeviceSize, uint32_t> allocated;
+
+  /** Bytes currently handed out */
+  VkDeviceSize used = 0;
+
+  /**
+   * Takes a free range of @a order, splitting a larger one if needed
+   *
+   * @returns false if no range is big enough
+   */
+  bool Allocate(uint32_t order, VkDeviceSize* offset);
+
+  /**
+   * Returns the range at @a offset and merges it with its free buddies
+   */
+  void Free(VkDeviceSize offset);
+
+  /**
+   * @returns size of the largest free range
+   */
+  VkDeviceSize LargestFreeRange() const;
+};
+
+bool ValiumMemoryBlock::Allocate(uint32_t order, VkDeviceSize* offset) {
+  uint32_t k = order;
+  while (k <= maxOrder && freeLists[k].empty()) {
+    k++;
+  }
+  if (k > maxOrder) {
+    return false;
+  }
+
+  VkDeviceSize start = *freeLists[k].begin();
+  freeLists[k].erase(freeLists[k].begin());
+
+  // Keep the front half, free the back half, until the range fits
+  while (k > order) {
+    k--;
+    freeLists[k].insert(start + (ALLOCATOR_MIN_ALLOCATION << k));
+  }
+
+  allocated[start] = order;
+  used += ALLOCATOR_MIN_ALLOCATION << order;
+  *offset = start;
+  return true;
+}
+
+void ValiumMemoryBlock::Free(VkDeviceSize offset) {
+  auto range = allocated.find(offset);
+  if (range == allocated.end()) {
+    throw std::runtime_error("freed memory that wasn't allocated from this block!");
+  }
+  uint32_t order = range->second;
+  allocated.erase(range);
+  used -= ALLOCATOR_MIN_ALLOCATION << order;
+
+  while (order < maxOrder) {
+    VkDeviceSize buddy = offset ^ (ALLOCATOR_MIN_ALLOCATION << order);
+    auto free = freeLists[order].find(buddy);
+    if (free == freeLists[order].end()) {
+      break;
+    }
+    freeLists[order].erase(free);
+    offset = std::min(offset, buddy);
+    order++;
+  }
+  freeLists[order].insert(offset);
+}
+
+VkDeviceSize ValiumMemoryBlock::LargestFreeRange() const {
+  for (uint32_t k = maxOrder + 1; k > 0; k--) {
+    if (!freeLists[k - 1].empty()) {
+      return ALLOCATOR_MIN_ALLOCATION << (k - 1);
+    }
+  }
+  return 0;
+}
+
+struct ValiumAllocator::impl {
+  /** Device the memory is allocated on */
+  VkDevice _device;
+
+  /** Memory types and heaps of the physical device */
+  VkPhysicalDeviceMemoryProperties _memoryProperties;
+
+  /** Guards everything below */
+  std::mutex _mutex;
+
+  /** Every block, for all memory types */
+  std::vector<ValiumMemoryBlock*> _blocks;
+
+  /** Block size for each memory type, smaller on small heaps */
+  std::vector<VkDeviceSize> _blockSizes;
+
+  /** Order of a whole block for each memory type */
+  std::vector<uint32_t> _blockOrders;
+
+  /** Live dedicated allocations per memory type */
+  std::vector<uint32_t> _dedicatedCount;
+
+  /** Bytes in live dedicated allocations per memory type */
+  std::vector<VkDeviceSize> _dedicatedBytes;
+
+  /**
+   * Finds the best memory type allowed by @a typeBits for @a usage
+   */
+  uint32_t _FindMemoryType(uint32_t typeBits, ValiumMemoryUsage usage);
+
+  /**
+   * Calls vkAllocateMemory and maps the result if it is host visible
+   */
+  VkDeviceMemory _AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+
+  /**
+   * Creates an empty block. Must be called with @a _mutex held.
+   */
+  ValiumMemoryBlock* _CreateBlock(uint32_t memoryType, bool linear);
+
+  /**
+   * Frees a block's memory and removes it. Must be called with @a _mutex held.
+   */
+  void _DestroyBlock(ValiumMemoryBlock* block);
+};
+
+/**
+ * Largest power of two that is no bigger than @a value
+ */
+static VkDeviceSize FloorPowerOfTwo(VkDeviceSize value) {
+  VkDeviceSize result = 1;
+  while (result <= value / 2) {
+    result *= 2;
+  }
+  return result;
+}
+
+ValiumAllocator::ValiumAllocator(VkPhysicalDevice physicalDevice, VkDevice device) {
+  _impl = new impl();
+  _impl->_device = device;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_impl->_memoryProperties);
+
+  uint32_t typeCount = _impl->_memoryProperties.memoryTypeCount;
+  _impl->_blockSizes.resize(typeCount);
+  _impl->_blockOrders.resize(typeCount);
+  _impl->_dedicatedCount.resize(typeCount, 0);
+  _impl->_dedicatedBytes.resize(typeCount, 0);
+
+  for (uint32_t type = 0; type < typeCount; type++) {
+    // A small heap, like the 256MB host visible window into VRAM, shouldn't
+    // be claimed by a handful of mostly empty blocks
+    uint32_t heap = _impl->_memoryProperties.memoryTypes[type].heapIndex;
+    VkDeviceSize heapSize = _impl->_memoryProperties.memoryHeaps[heap].size;
+    VkDeviceSize blockSize = std::min<VkDeviceSize>(ALLOCATOR_BLOCK_SIZE, FloorPowerOfTwo(std::max<VkDeviceSize>(heapSize / 8, ALLOCATOR_MIN_ALLOCATION)));
+    blockSize = std::max<VkDeviceSize>(blockSize, ALLOCATOR_MIN_ALLOCATION);
+
+    uint32_t order = 0;
+    while ((ALLOCATOR_MIN_ALLOCATION << order) < blockSize) {
+      order++;
+    }
+    _impl->_blockSizes[type] = blockSize;
+    _impl->_blockOrders[type] = order;
+  }
+}
+
+ValiumAllocator::~ValiumAllocator() {
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying allocator with " << _impl->_blocks.size() << " blocks" << std::endl;
+#endif
+  while (!_impl->_blocks.empty()) {
+    _impl->_DestroyBlock(_impl->_blocks.back());
+  }
+  delete _impl;
+}
+
+uint32_t ValiumAllocator::impl::_FindMemoryType(uint32_t typeBits, ValiumMemoryUsage usage) {
+  VkMemoryPropertyFlags required = 0;
+  VkMemoryPropertyFlags preferred = 0;
+  switch (usage) {
+    case ValiumMemoryUsage::GpuOnly:
+      preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+      break;
+    case ValiumMemoryUsage::CpuToGpu:
+      required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+      break;
+    case ValiumMemoryUsage::GpuToCpu:
+      required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+      preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+      break;
+  }
+
+  // Types are ordered by the driver from best to worst, so the first match wins
+  for (VkMemoryPropertyFlags wanted : {required | preferred, required}) {
+    for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++) {
+      if ((typeBits & (1u << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted) {
+        return i;
+      }
+    }
+  }
+
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceMemory ValiumAllocator::impl::_AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Allocating " << size << " bytes of memory type " << memoryType << std::endl;
+#endif
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate device memory!");
+  }
+
+  *mapped = nullptr;
+  if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+      vkFreeMemory(_device, memory, nullptr);
+      throw std::runtime_error("failed to map device memory!");
+    }
+  }
+  return memory;
+}
+
+ValiumMemoryBlock* ValiumAllocator::impl::_CreateBlock(uint32_t memoryType, bool linear) {
+  ValiumMemoryBlock* block = new ValiumMemoryBlock();
+  block->size = _blockSizes[memoryType];
+  block->maxOrder = _blockOrders[memoryType];
+  block->memoryType = memoryType;
+  block->linear = linear;
+  block->freeLists.resize(block->maxOrder + 1);
+  block->freeLists[block->maxOrder].insert(0);
+
+  try {
+    block->memory = _AllocateDeviceMemory(block->size, memoryType, &block->mapped);
+  } catch (...) {
+    delete block;
+    throw;
+  }
+
+  _blocks.push_back(block);
+  return block;
+}
+
+void ValiumAllocator::impl::_DestroyBlock(ValiumMemoryBlock* block) {
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Freeing " << block->size << " bytes of memory type " << block->memoryType << std::endl;
+#endif
+  // Freeing memory implicitly unmaps it
+  vkFreeMemory(_device, block->memory, nullptr);
+  _blocks.erase(std::find(_blocks.begin(), _blocks.end(), block));
+  delete block;
+}
+
+ValiumAllocation ValiumAllocator::Allocate(const VkMemoryRequirements& requirements, ValiumMemoryUsage usage, bool linear, bool dedicated) {
+  uint32_t memoryType = _impl->_FindMemoryType(requirements.memoryTypeBits, usage);
+
+  ValiumAllocation allocation;
+  allocation.memoryType = memoryType;
+
+  // Big resources would waste most of a block, give them their own memory
+  if (dedicated || requirements.size > _impl->_blockSizes[memoryType] / 2) {
+    allocation.memory = _impl->_AllocateDeviceMemory(requirements.size, memoryType, &allocation.mapped);
+    allocation.size = requirements.size;
+    allocation.dedicated = true;
+
+    std::lock_guard<std::mutex> lock(_impl->_mutex);
+    _impl->_dedicatedCount[memoryType]++;
+    _impl->_dedicatedBytes[memoryType] += requirements.size;
+    return allocation;
+  }
+
+  // Ranges are aligned to their size, so covering the alignment covers both
+  VkDeviceSize needed = std::max(requirements.size, requirements.alignment);
+  uint32_t order = 0;
+  while ((ALLOCATOR_MIN_ALLOCATION << order) < needed) {
+    order++;
+  }
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  VkDeviceSize offset = 0;
+  ValiumMemoryBlock* chosen = nullptr;
+  for (ValiumMemoryBlock* block : _impl->_blocks) {
+    if (block->memoryType == memoryType && block->linear == linear && block->Allocate(order, &offset)) {
+      chosen = block;
+      break;
+    }
+  }
+  if (chosen == nullptr) {
+    chosen = _impl->_CreateBlock(memoryType, linear);
+    chosen->Allocate(order, &offset);
+  }
+
+  allocation.memory = chosen->memory;
+  allocation.offset = offset;
+  allocation.size = ALLOCATOR_MIN_ALLOCATION << order;
+  allocation.mapped = chosen->mapped ? static_cast<char*>(chosen->mapped) + offset : nullptr;
+  allocation._block = chosen;
+  return allocation;
+}
+
+ValiumAllocation ValiumAllocator::AllocateForBuffer(VkBuffer buffer, ValiumMemoryUsage usage) {
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(_impl->_device, buffer, &requirements);
+
+  ValiumAllocation allocation = Allocate(requirements, usage, true);
+  if (vkBindBufferMemory(_impl->_device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+    Free(allocation);
+    throw std::runtime_error("failed to bind buffer memory!");
+  }
+  return allocation;
+}
+
+ValiumAllocation ValiumAllocator::AllocateForImage(VkImage image, ValiumMemoryUsage usage, bool dedicated) {
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(_impl->_device, image, &requirements);
+
+  ValiumAllocation allocation = Allocate(requirements, usage, false, dedicated);
+  if (vkBindImageMemory(_impl->_device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+    Free(allocation);
+    throw std::runtime_error("failed to bind image memory!");
+  }
+  return allocation;
+}
+
+void ValiumAllocator::Free(ValiumAllocation& allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) {
+    return;
+  }
+
+  if (allocation.dedicated) {
+    vkFreeMemory(_impl->_device, allocation.memory, nullptr);
+    std::lock_guard<std::mutex> lock(_impl->_mutex);
+    _impl->_dedicatedCount[allocation.memoryType]--;
+    _impl->_dedicatedBytes[allocation.memoryType] -= allocation.size;
+  } else {
+    std::lock_guard<std::mutex> lock(_impl->_mutex);
+    ValiumMemoryBlock* block = static_cast<ValiumMemoryBlock*>(allocation._block);
+    block->Free(allocation.offset);
+
+    // Keep one empty block per pool around so freeing and reallocating
+    // the last resource doesn't hit vkAllocateMemory every time
+    if (block->used == 0) {
+      for (ValiumMemoryBlock* other : _impl->_blocks) {
+        if (other != block && other->used == 0 && other->memoryType == block->memoryType && other->linear == block->linear) {
+          _impl->_DestroyBlock(block);
+          break;
+        }
+      }
+    }
+  }
+
+  allocation = ValiumAllocation();
+}
+
+std::vector<ValiumHeapStats> ValiumAllocator::GetHeapStats() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+
+  std::vector<ValiumHeapStats> stats(_impl->_memoryProperties.memoryHeapCount);
+  for (uint32_t heap = 0; heap < stats.size(); heap++) {
+    stats[heap].heapSize = _impl->_memoryProperties.memoryHeaps[heap].size;
+  }
+
+  for (uint32_t type = 0; type < _impl->_memoryProperties.memoryTypeCount; type++) {
+    ValiumHeapStats& heap = stats[_impl->_memoryProperties.memoryTypes[type].heapIndex];
+    heap.reservedBytes += _impl->_dedicatedBytes[type];
+    heap.usedBytes += _impl->_dedicatedBytes[type];
+    heap.deviceAllocations += _impl->_dedicatedCount[type];
+    heap.allocations += _impl->_dedicatedCount[type];
+  }
+
+  for (const ValiumMemoryBlock* block : _impl->_blocks) {
+    ValiumHeapStats& heap = stats[_impl->_memoryProperties.memoryTypes[block->memoryType].heapIndex];
+    heap.reservedBytes += block->size;
+    heap.usedBytes += block->used;
+    heap.deviceAllocations++;
+    heap.allocations += static_cast<uint32_t>(block->allocated.size());
+    heap.largestFreeRange = std::max(heap.largestFreeRange, block->LargestFreeRange());
+  }
+
+  for (ValiumHeapStats& heap : stats) {
+    VkDeviceSize freeBytes = heap.reservedBytes - heap.usedBytes;
+    if (freeBytes > 0) {
+      heap.fragmentation = 1.0f - (float) heap.largestFreeRange / (float) freeBytes;
+    }
+  }
+
+  return stats;
+}
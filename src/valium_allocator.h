@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+/**
+ * How a resource's memory will be accessed, used to pick a memory type
+ */
+enum class ValiumMemoryUsage {
+  /** Only the GPU reads and writes it. Prefers device local memory. */
+  GpuOnly,
+
+  /** Written by the CPU, read by the GPU, e.g. staging or uniform data. Host visible. */
+  CpuToGpu,
+
+  /** Written by the GPU, read back by the CPU. Host visible, prefers cached. */
+  GpuToCpu
+};
+
+/**
+ * A range of device memory handed out by ValiumAllocator.
+ * Free it with ValiumAllocator::Free().
+ */
+struct ValiumAllocation {
+  /** Memory object the range lives in, shared with other allocations unless dedicated */
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+
+  /** Offset of the range in @a memory */
+  VkDeviceSize offset = 0;
+
+  /** Size of the range, at least the requested size */
+  VkDeviceSize size = 0;
+
+  /** Pointer to the range when the memory is host visible, otherwise nullptr */
+  void* mapped = nullptr;
+
+  /** Index of the memory type the range was allocated from */
+  uint32_t memoryType = 0;
+
+  /** True if @a memory belongs to this allocation alone */
+  bool dedicated = false;
+
+  /** Block the range was carved from, owned by the allocator */
+  void* _block = nullptr;
+};
+
+/**
+ * Usage of one memory heap
+ */
+struct ValiumHeapStats {
+  /** Size of the heap reported by the device */
+  VkDeviceSize heapSize = 0;
+
+  /** Bytes allocated from the device with vkAllocateMemory */
+  VkDeviceSize reservedBytes = 0;
+
+  /** Bytes handed out to allocations */
+  VkDeviceSize usedBytes = 0;
+
+  /** Number of block and dedicated vkAllocateMemory calls live */
+  uint32_t deviceAllocations = 0;
+
+  /** Number of live allocations, including dedicated ones */
+  uint32_t allocations = 0;
+
+  /** Largest range that could be sub-allocated without a new block */
+  VkDeviceSize largestFreeRange = 0;
+
+  /**
+   * 0 when all free block memory is one range, approaching 1 as it is
+   * split into many small ranges: 1 - largestFreeRange / free bytes
+   */
+  float fragmentation = 0.0f;
+};
+
+/**
+ * Sub-allocates device memory from large blocks.
+ *
+ * Devices limit the number of live vkAllocateMemory calls and each call is
+ * slow, so resources share blocks of ALLOCATOR_BLOCK_SIZE bytes. Each block
+ * is managed as a buddy allocator, which keeps every range naturally
+ * aligned to its power of two size. Buffers and images get separate blocks
+ * so bufferImageGranularity never has to be padded for. Requests larger
+ * than half a block, or flagged as dedicated, get their own memory object.
+ *
+ * Host visible blocks are mapped once when created. Safe to use from
+ * several threads.
+ */
+class ValiumAllocator
+{
+ public:
+  /**
+   * @param[in] physicalDevice Device to read memory types and heaps from
+   * @param[in] device Device to allocate on
+   */
+  ValiumAllocator(VkPhysicalDevice physicalDevice, VkDevice device);
+
+  /**
+   * Frees every block. All allocations must have been freed already.
+   */
+  ~ValiumAllocator();
+
+  /**
+   * Allocates memory for the given requirements
+   *
+   * @param[in] requirements Size, alignment and allowed memory types
+   * @param[in] usage How the memory will be accessed
+   * @param[in] linear True for buffers and linear images, false for optimal images
+   * @param[in] dedicated Forces a memory object of its own
+   */
+  ValiumAllocation Allocate(const VkMemoryRequirements& requirements, ValiumMemoryUsage usage, bool linear, bool dedicated = false);
+
+  /**
+   * Allocates memory for @a buffer and binds it
+   */
+  ValiumAllocation AllocateForBuffer(VkBuffer buffer, ValiumMemoryUsage usage);
+
+  /**
+   * Allocates memory for an optimally tiled @a image and binds it
+   *
+   * @param[in] dedicated Forces a memory object of its own, e.g. for render targets
+   */
+  ValiumAllocation AllocateForImage(VkImage image, ValiumMemoryUsage usage, bool dedicated = false);
+
+  /**
+   * Returns the range to its block and resets @a allocation
+   */
+  void Free(ValiumAllocation& allocation);
+
+  /**
+   * @returns usage and fragmentation of every memory heap, indexed by heap
+   */
+  std::vector<ValiumHeapStats> GetHeapStats();
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -0,0 +1,249 @@
+#include "valium_bindless.h"
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/**
+ * Slot indices of one array in the table
+ */
+struct ValiumBindlessSlots {
+  /** Number of slots in the array */
+  uint32_t capacity = 0;
+
+  /** Slots below this have been handed out at least once */
+  uint32_t next = 0;
+
+  /** Released slots ready to be handed out again */
+  std::vector<uint32_t> free;
+
+  /** Released slots and the frame boundaries left before they are free */
+  std::vector<std::pair<uint32_t, uint32_t>> retired;
+
+  /**
+   * @returns an unused slot, reusing released ones first
+   */
+  uint32_t Acquire() {
+    if (!free.empty()) {
+      uint32_t index = free.back();
+      free.pop_back();
+      return index;
+    }
+    if (next == capacity) {
+      throw std::runtime_error("bindless table is full!");
+    }
+    return next++;
+  }
+
+  /**
+   * Counts down the retired slots, freeing the ones no frame can read anymore
+   */
+  void Age() {
+    for (auto it = retired.begin(); it != retired.end(); ) {
+      if (--it->second == 0) {
+        free.push_back(it->first);
+        it = retired.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+};
+
+struct ValiumBindlessTable::impl {
+  /** Device the table is created on */
+  VkDevice _device;
+
+  /** Layout with both arrays, created with the update-after-bind pool flag */
+  VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+
+  /** Update-after-bind pool holding only @a _set */
+  VkDescriptorPool _pool = VK_NULL_HANDLE;
+
+  /** The table */
+  VkDescriptorSet _set = VK_NULL_HANDLE;
+
+  /** Slots of the sampled image array */
+  ValiumBindlessSlots _images;
+
+  /** Slots of the storage buffer array */
+  ValiumBindlessSlots _buffers;
+
+  /** Frame boundaries a removed slot waits before being reused */
+  uint32_t _framesInFlight;
+
+  /** Guards the slots and descriptor writes */
+  std::mutex _mutex;
+
+  /**
+   * Destroys whatever was created so far
+   */
+  void _Destroy();
+};
+
+void ValiumBindlessTable::impl::_Destroy() {
+  // Destroying the pool frees the set
+  if (_pool != VK_NULL_HANDLE) {
+    vkDestroyDescriptorPool(_device, _pool, nullptr);
+  }
+  if (_layout != VK_NULL_HANDLE) {
+    vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+  }
+}
+
+ValiumBindlessTable::ValiumBindlessTable(VkDevice device, uint32_t imageCount, uint32_t bufferCount, uint32_t framesInFlight) {
+  _impl = new impl();
+  _impl->_device = device;
+  _impl->_images.capacity = imageCount;
+  _impl->_buffers.capacity = bufferCount;
+  _impl->_framesInFlight = framesInFlight;
+
+  VkDescriptorSetLayoutBinding bindings[2]{};
+  bindings[0].binding = IMAGE_BINDING;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+  bindings[0].descriptorCount = imageCount;
+  bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+  bindings[1].binding = BUFFER_BINDING;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[1].descriptorCount = bufferCount;
+  bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+  // Slots are written while recorded command buffers use the set, and
+  // shaders only read the slots that have been written
+  VkDescriptorBindingFlagsEXT bindingFlags[2] = {
+    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT,
+    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+  };
+  VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo{};
+  flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+  flagsInfo.bindingCount = 2;
+  flagsInfo.pBindingFlags = bindingFlags;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.pNext = &flagsInfo;
+  layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings = bindings;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating bindless table of " << imageCount << " images and " << bufferCount << " buffers" << std::endl;
+#endif
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &_impl->_layout) != VK_SUCCESS) {
+    delete _impl;
+    throw std::runtime_error("failed to create bindless descriptor set layout!");
+  }
+
+  VkDescriptorPoolSize sizes[2] = {
+    {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageCount},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferCount}
+  };
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = sizes;
+
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &_impl->_pool) != VK_SUCCESS) {
+    _impl->_Destroy();
+    delete _impl;
+    throw std::runtime_error("failed to create bindless descriptor pool!");
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = _impl->_pool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &_impl->_layout;
+
+  if (vkAllocateDescriptorSets(device, &allocInfo, &_impl->_set) != VK_SUCCESS) {
+    _impl->_Destroy();
+    delete _impl;
+    throw std::runtime_error("failed to allocate bindless descriptor set!");
+  }
+}
+
+ValiumBindlessTable::~ValiumBindlessTable() {
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying bindless table" << std::endl;
+#endif
+  _impl->_Destroy();
+  delete _impl;
+}
+
+void ValiumBindlessTable::BeginFrame() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  _impl->_images.Age();
+  _impl->_buffers.Age();
+}
+
+uint32_t ValiumBindlessTable::AddImage(VkImageView view, VkImageLayout layout) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  uint32_t index = _impl->_images.Acquire();
+
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.imageView = view;
+  imageInfo.imageLayout = layout;
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = _impl->_set;
+  write.dstBinding = IMAGE_BINDING;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+  write.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(_impl->_device, 1, &write, 0, nullptr);
+  return index;
+}
+
+uint32_t ValiumBindlessTable::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  uint32_t index = _impl->_buffers.Acquire();
+
+  VkDescriptorBufferInfo bufferInfo{};
+  bufferInfo.buffer = buffer;
+  bufferInfo.offset = offset;
+  bufferInfo.range = range;
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = _impl->_set;
+  write.dstBinding = BUFFER_BINDING;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = &bufferInfo;
+  vkUpdateDescriptorSets(_impl->_device, 1, &write, 0, nullptr);
+  return index;
+}
+
+void ValiumBindlessTable::RemoveImage(uint32_t index) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  // The stale descriptor stays until the slot is written again
+  _impl->_images.retired.push_back({index, _impl->_framesInFlight});
+}
+
+void ValiumBindlessTable::RemoveBuffer(uint32_t index) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  _impl->_buffers.retired.push_back({index, _impl->_framesInFlight});
+}
+
+VkDescriptorSetLayout ValiumBindlessTable::GetSetLayout() const {
+  return _impl->_layout;
+}
+
+VkDescriptorSet ValiumBindlessTable::GetDescriptorSet() const {
+  return _impl->_set;
+}
+
+uint32_t ValiumBindlessTable::GetImageCapacity() const {
+  return _impl->_images.capacity;
+}
+
+uint32_t ValiumBindlessTable::GetBufferCapacity() const {
+  return _impl->_buffers.capacity;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+/**
+ * One large descriptor set that shaders index by integer instead of
+ * binding descriptors per draw.
+ *
+ * Binding 0 is an array of sampled images, binding 1 an array of storage
+ * buffers. AddImage() and AddBuffer() write a descriptor into a free slot
+ * and return its index, which is handed to shaders through push constants
+ * or buffer data. The set is bound once per command buffer and stays valid
+ * while slots are added, even in command buffers that were already recorded,
+ * since the bindings are update-after-bind and partially bound.
+ *
+ * Needs VK_EXT_descriptor_indexing with the features enabled by
+ * ValiumDevice when ValiumOptions::bindless is set. Safe to use from
+ * several threads.
+ */
+class ValiumBindlessTable
+{
+ public:
+  /** Binding of the sampled image array */
+  static const uint32_t IMAGE_BINDING = 0;
+
+  /** Binding of the storage buffer array */
+  static const uint32_t BUFFER_BINDING = 1;
+
+  /**
+   * Creates the layout, pool and set
+   *
+   * @param[in] device Device with descriptor indexing enabled
+   * @param[in] imageCount Slots in the sampled image array
+   * @param[in] bufferCount Slots in the storage buffer array
+   * @param[in] framesInFlight Frames that may still read a removed slot
+   */
+  ValiumBindlessTable(VkDevice device, uint32_t imageCount, uint32_t bufferCount, uint32_t framesInFlight);
+  ~ValiumBindlessTable();
+
+  /**
+   * Frees slots removed long enough ago that no frame in flight can read
+   * them. Call once per frame at a frame boundary.
+   */
+  void BeginFrame();
+
+  /**
+   * Writes @a view into a free slot of the image array
+   *
+   * @param[in] view View of an image created with VK_IMAGE_USAGE_SAMPLED_BIT
+   * @param[in] layout Layout the image is in when shaders read it
+   * @returns the index shaders read the image at
+   */
+  uint32_t AddImage(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  /**
+   * Writes a range of @a buffer into a free slot of the buffer array
+   *
+   * @param[in] buffer Buffer created with VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+   * @returns the index shaders read the buffer at
+   */
+  uint32_t AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+  /**
+   * Releases an image slot. It is reused once frames in flight are done with it.
+   */
+  void RemoveImage(uint32_t index);
+
+  /**
+   * Releases a buffer slot. It is reused once frames in flight are done with it.
+   */
+  void RemoveBuffer(uint32_t index);
+
+  /**
+   * @returns the layout of the set, to place in pipeline layouts
+   */
+  VkDescriptorSetLayout GetSetLayout() const;
+
+  /**
+   * @returns the set to bind
+   */
+  VkDescriptorSet GetDescriptorSet() const;
+
+  /**
+   * @returns the number of slots in the image array
+   */
+  uint32_t GetImageCapacity() const;
+
+  /**
+   * @returns the number of slots in the buffer array
+   */
+  uint32_t GetBufferCapacity() const;
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -0,0 +1,76 @@
+#include "valium_buffer.h"
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+struct ValiumBuffer::impl {
+  /** Allocator @a _memory came from */
+  ValiumAllocator* _allocator;
+
+  /** Device that owns the buffer */
+  VkDevice _device;
+
+  /** The buffer */
+  VkBuffer _buffer = VK_NULL_HANDLE;
+
+  /** Memory bound to @a _buffer */
+  ValiumAllocation _memory;
+
+  /** Size the buffer was created with */
+  VkDeviceSize _size = 0;
+};
+
+ValiumBuffer::ValiumBuffer(ValiumAllocator* allocator, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage, ValiumMemoryUsage memoryUsage) {
+  _impl = new impl();
+  _impl->_allocator = allocator;
+  _impl->_device = device;
+  _impl->_size = size;
+
+  if (memoryUsage == ValiumMemoryUsage::GpuOnly) {
+    usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  }
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating buffer of " << size << " bytes" << std::endl;
+#endif
+  if (vkCreateBuffer(device, &bufferInfo, nullptr, &_impl->_buffer) != VK_SUCCESS) {
+    delete _impl;
+    throw std::runtime_error("failed to create buffer!");
+  }
+
+  try {
+    _impl->_memory = allocator->AllocateForBuffer(_impl->_buffer, memoryUsage);
+  } catch (...) {
+    vkDestroyBuffer(device, _impl->_buffer, nullptr);
+    delete _impl;
+    throw;
+  }
+}
+
+ValiumBuffer::~ValiumBuffer() {
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying buffer" << std::endl;
+#endif
+  vkDestroyBuffer(_impl->_device, _impl->_buffer, nullptr);
+  _impl->_allocator->Free(_impl->_memory);
+  delete _impl;
+}
+
+VkBuffer ValiumBuffer::GetVkBuffer() const {
+  return _impl->_buffer;
+}
+
+VkDeviceSize ValiumBuffer::GetSize() const {
+  return _impl->_size;
+}
+
+void* ValiumBuffer::GetMapped() const {
+  return _impl->_memory.mapped;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "valium_allocator.h"
+#include <vulkan/vulkan.h>
+
+/**
+ * A VkBuffer and the memory bound to it.
+ *
+ * Device local buffers (ValiumMemoryUsage::GpuOnly) can't be written by the
+ * CPU, fill them with ValiumUploader. Host visible buffers stay mapped and
+ * can be written through GetMapped().
+ */
+class ValiumBuffer
+{
+ public:
+  /**
+   * Creates the buffer and allocates its memory
+   *
+   * @param[in] allocator Allocator the memory comes from
+   * @param[in] device Device to create the buffer on
+   * @param[in] size Size in bytes
+   * @param[in] usage How the buffer is used. Device local buffers are also
+   *                  made transfer destinations so they can be uploaded to.
+   * @param[in] memoryUsage How the memory is accessed
+   */
+  ValiumBuffer(ValiumAllocator* allocator, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage, ValiumMemoryUsage memoryUsage = ValiumMemoryUsage::GpuOnly);
+  ~ValiumBuffer();
+
+  /**
+   * @returns the buffer handle
+   */
+  VkBuffer GetVkBuffer() const;
+
+  /**
+   * @returns the size the buffer was created with
+   */
+  VkDeviceSize GetSize() const;
+
+  /**
+   * @returns a pointer to the buffer's memory, nullptr unless host visible
+   */
+  void* GetMapped() const;
+
+ private:
+  struct impl;
+  impl* _impl;
+};
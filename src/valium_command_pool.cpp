@@ -1,81 +1,216 @@
 #include "valium_command_pool.h"
+#include <stdexcept>
+#include <vector>
 #ifdef SHOW_RESOURCE_ALLOCATION
 #include <iostream>
 #endif
 
+/**
+ * A command pool and the buffers allocated from it
+ */
+struct ValiumPoolSlot {
+  /** Command pool, only used by one thread at a time */
+  VkCommandPool pool = VK_NULL_HANDLE;
+
+  /** Buffers allocated from @a pool, reused every time the pool is reset */
+  std::vector<VkCommandBuffer> buffers;
+
+  /** Number of @a buffers handed out since the last reset */
+  size_t used = 0;
+};
+
 struct ValiumCommandPool::impl {
   /** Device used for submitting commands to */
   VkDevice _device;
 
-  /** Command pool */
-  VkCommandPool _pool = VK_NULL_HANDLE;
+  /** Family the pools are created on */
+  uint32_t _family;
+
+  /** Number of threads recording secondary buffers */
+  uint32_t _threadCount;
+
+  /** Pool of each frame's primary command buffer */
+  std::vector<ValiumPoolSlot> _primary;
 
-  /** Command buffer to be used in the pool */
-  VkCommandBuffer _buffer;
+  /** Secondary pools, @a _threadCount per frame in flight */
+  std::vector<ValiumPoolSlot> _secondary;
 
   /**
-   * Construts the command pool with the graphics family index.
+   * Pool of the static buffers, indexed by image. Created on first use.
+   * Its buffers are reset one at a time as images are re-recorded.
+   */
+  ValiumPoolSlot _static;
+
+  /**
+   * Construts a command pool with the graphics family index.
    *
-   * @param[in] indices Queue indices that contains a graphics family
+   * @param[in] flags Creation flags of the pool
    */
-  void CreateCommandPool(QueueFamilyIndices indices);
+  VkCommandPool CreateCommandPool(VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
 
   /**
-   * Allocates a command buffer from ValiumCommandPool::impl::_pool
+   * Hands out the next buffer of @a slot, allocating one if they're all in use
+   *
+   * @param[in] slot Pool to take the buffer from
+   * @param[in] level Level to allocate new buffers with
    */
-  void AllocateCommandBuffer();
+  VkCommandBuffer NextBuffer(ValiumPoolSlot& slot, VkCommandBufferLevel level);
 };
 
-ValiumCommandPool::ValiumCommandPool(VkDevice device, QueueFamilyIndices indices) {
+ValiumCommandPool::ValiumCommandPool(VkDevice device, QueueFamilyIndices indices, uint32_t frameCount, uint32_t threadCount) {
   _impl = new impl();
-  _impl->CreateCommandPool(indices);
-  _impl->AllocateCommandBuffer();
+  _impl->_device = device;
+  _impl->_family = indices.graphicsFamily.value();
+  _impl->_threadCount = threadCount;
+  _impl->_primary.resize(frameCount);
+  _impl->_secondary.resize(frameCount * threadCount);
+
+  try {
+    for (ValiumPoolSlot& slot : _impl->_primary) {
+      slot.pool = _impl->CreateCommandPool();
+    }
+    for (ValiumPoolSlot& slot : _impl->_secondary) {
+      slot.pool = _impl->CreateCommandPool();
+    }
+  } catch (...) {
+    for (ValiumPoolSlot& slot : _impl->_primary) {
+      vkDestroyCommandPool(device, slot.pool, nullptr);
+    }
+    for (ValiumPoolSlot& slot : _impl->_secondary) {
+      vkDestroyCommandPool(device, slot.pool, nullptr);
+    }
+    delete _impl;
+    throw;
+  }
 }
 
 ValiumCommandPool::~ValiumCommandPool() {
-  if (_impl->_pool != VK_NULL_HANDLE) {
 #ifdef SHOW_RESOURCE_ALLOCATION
-    std::cout << "Freeing command pool" << std::endl;
+  std::cout << "Freeing " << _impl->_primary.size() + _impl->_secondary.size() << " command pools" << std::endl;
 #endif
-    vkDestroyCommandPool(_impl->_device, _impl->_pool, nullptr);
+  // Destroying a pool frees its buffers
+  for (ValiumPoolSlot& slot : _impl->_primary) {
+    vkDestroyCommandPool(_impl->_device, slot.pool, nullptr);
+  }
+  for (ValiumPoolSlot& slot : _impl->_secondary) {
+    vkDestroyCommandPool(_impl->_device, slot.pool, nullptr);
+  }
+  if (_impl->_static.pool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(_impl->_device, _impl->_static.pool, nullptr);
   }
   delete _impl;
 }
 
-void ValiumCommandPool::impl::CreateCommandPool(QueueFamilyIndices indices) {
+VkCommandPool ValiumCommandPool::impl::CreateCommandPool(VkCommandPoolCreateFlags flags) {
   VkCommandPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  poolInfo.queueFamilyIndex = indices.graphicsFamily.value();
+  // By default buffers are only reset with their pool, and are re-recorded every frame
+  poolInfo.flags = flags;
+  poolInfo.queueFamilyIndex = _family;
 #ifdef SHOW_RESOURCE_ALLOCATION
   std::cout << "Creating command pool" << std::endl;
 #endif
-  if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_pool) != VK_SUCCESS) {
+  VkCommandPool pool;
+  if (vkCreateCommandPool(_device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
+  return pool;
 }
 
-void ValiumCommandPool::impl::AllocateCommandBuffer() {
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.commandPool = _pool;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandBufferCount = 1;
+VkCommandBuffer ValiumCommandPool::impl::NextBuffer(ValiumPoolSlot& slot, VkCommandBufferLevel level) {
+  if (slot.used == slot.buffers.size()) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = slot.pool;
+    allocInfo.level = level;
+    allocInfo.commandBufferCount = 1;
 
-  if (vkAllocateCommandBuffers(_device, &allocInfo, &_buffer) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate command buffers!");
+    VkCommandBuffer buffer;
+    if (vkAllocateCommandBuffers(_device, &allocInfo, &buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate command buffers!");
+    }
+    slot.buffers.push_back(buffer);
   }
+  return slot.buffers[slot.used++];
 }
 
-VkCommandBuffer ValiumCommandPool::RecordCommand(uint32_t imgIndex) {
+VkCommandBuffer ValiumCommandPool::RecordCommand(uint32_t frame) {
+  // One call per pool resets every buffer recorded from it last time
+  ValiumPoolSlot& primary = _impl->_primary.at(frame);
+  vkResetCommandPool(_impl->_device, primary.pool, 0);
+  primary.used = 0;
+  for (uint32_t thread = 0; thread < _impl->_threadCount; thread++) {
+    ValiumPoolSlot& secondary = _impl->_secondary[frame * _impl->_threadCount + thread];
+    if (secondary.used > 0) {
+      vkResetCommandPool(_impl->_device, secondary.pool, 0);
+      secondary.used = 0;
+    }
+  }
+
+  VkCommandBuffer buffer = _impl->NextBuffer(primary, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = 0; // Optional
+  // Every frame is re-recorded, so each recording is only submitted once
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
   beginInfo.pInheritanceInfo = nullptr; // Optional
 
-  if (vkBeginCommandBuffer(_impl->_buffer, &beginInfo) != VK_SUCCESS) {
+  if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS) {
     throw std::runtime_error("failed to begin recording command buffer!");
   }
 
-  return _impl->_buffer;
+  return buffer;
+}
+
+VkCommandBuffer ValiumCommandPool::BeginSecondary(uint32_t frame, uint32_t thread, const VkCommandBufferInheritanceInfo& inheritance) {
+  if (thread >= _impl->_threadCount) {
+    throw std::runtime_error("no command pool for recording thread!");
+  }
+  ValiumPoolSlot& slot = _impl->_secondary.at(frame * _impl->_threadCount + thread);
+  VkCommandBuffer buffer = _impl->NextBuffer(slot, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = &inheritance;
+
+  if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording secondary command buffer!");
+  }
+
+  return buffer;
+}
+
+VkCommandBuffer ValiumCommandPool::RecordStatic(uint32_t image) {
+  ValiumPoolSlot& slot = _impl->_static;
+  if (slot.pool == VK_NULL_HANDLE) {
+    slot.pool = _impl->CreateCommandPool(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  }
+  // Images are recorded in any order, allocate every buffer up to this one
+  while (slot.buffers.size() <= image) {
+    slot.used = slot.buffers.size();
+    _impl->NextBuffer(slot, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  }
+
+  VkCommandBuffer buffer = slot.buffers[image];
+  vkResetCommandBuffer(buffer, 0);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  // No ONE_TIME_SUBMIT, the recording is resubmitted every time the image comes around
+  beginInfo.flags = 0;
+
+  if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording static command buffer!");
+  }
+
+  return buffer;
+}
+
+VkCommandBuffer ValiumCommandPool::GetStatic(uint32_t image) {
+  return _impl->_static.buffers.at(image);
+}
+
+uint32_t ValiumCommandPool::GetThreadCount() {
+  return _impl->_threadCount;
 }
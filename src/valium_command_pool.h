@@ -4,29 +4,79 @@
 #include "valium_queue.h"
 
 /**
- * Manages the vulkan command queue.
- * Upon constructing this class, a command pool and a single command buffer
- * will be allocated.
+ * Manages the command pools frames are recorded with.
+ *
+ * Each frame in flight has a pool for its primary command buffer and one
+ * pool per recording thread for secondary command buffers. Command pools
+ * must only be used by one thread at a time, so giving every thread its own
+ * pool lets them record without locking. All of a frame's pools are reset
+ * together with vkResetCommandPool() when the frame is recorded again,
+ * which is cheaper than resetting each buffer.
+ *
+ * Static buffers are kept separately, one per image, and are only
+ * re-recorded when what they draw changes.
  */
 class ValiumCommandPool
 {
  public:
   /**
-   * Constructs a command pool on the given device
+   * Constructs the command pools on the given device
    *
-   * @param[in] device Device to create the command pool for
+   * @param[in] device Device to create the command pools for
    * @param[in] indices Queue family indices that contains the graphicsFamily index
+   * @param[in] frameCount Number of frames in flight
+   * @param[in] threadCount Number of threads recording secondary command buffers
    */
-  ValiumCommandPool(VkDevice device, QueueFamilyIndices indices);
+  ValiumCommandPool(VkDevice device, QueueFamilyIndices indices, uint32_t frameCount = 1, uint32_t threadCount = 0);
   ~ValiumCommandPool();
 
   /**
-   * Records a command into a buffer of the command pool
+   * Resets all of the given frame's pools and begins recording the frame's
+   * primary command buffer. The caller must end the buffer with
+   * vkEndCommandBuffer() before submitting.
    *
-   * @param[in] imgIndex index of the swapchain image to write to.
-   * @returns The command buffer to be passed to the render pass
+   * @note The frame's previous submission must have completed, wait on its fence first.
+   *
+   * @param[in] frame index of the frame in flight to record.
+   * @returns The command buffer to record the frame's commands into
+   */
+  VkCommandBuffer RecordCommand(uint32_t frame);
+
+  /**
+   * Begins recording a secondary command buffer from @a thread's pool.
+   * Buffers handed out this frame are reused after the next RecordCommand()
+   * for the same frame. The caller must end the buffer with vkEndCommandBuffer().
+   *
+   * @note Only one thread may use a given @a thread index at a time.
+   *       Call after RecordCommand() for @a frame.
+   *
+   * @param[in] frame index of the frame in flight being recorded
+   * @param[in] thread index of the recording thread, below GetThreadCount()
+   * @param[in] inheritance Renderpass, subpass and framebuffer the buffer is executed in
+   */
+  VkCommandBuffer BeginSecondary(uint32_t frame, uint32_t thread, const VkCommandBufferInheritanceInfo& inheritance);
+
+  /**
+   * Resets and begins recording the static command buffer of @a image.
+   * Unlike RecordCommand() the buffer may be submitted again and again
+   * until it is re-recorded. The caller must end it with vkEndCommandBuffer().
+   *
+   * @note The buffer's previous submission must have completed.
+   *
+   * @param[in] image Index of the image the buffer renders into
+   */
+  VkCommandBuffer RecordStatic(uint32_t image);
+
+  /**
+   * @returns the static command buffer last recorded with RecordStatic()
    */
-  VkCommandBuffer RecordCommand(uint32_t imgIndex);
+  VkCommandBuffer GetStatic(uint32_t image);
+
+  /**
+   * @returns the number of threads that may record secondary buffers
+   */
+  uint32_t GetThreadCount();
+
  private:
   struct impl;
   impl* _impl;
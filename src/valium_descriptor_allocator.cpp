@@ -0,0 +1,185 @@
+#include "valium_descriptor_allocator.h"
+#include "app_config.h"
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/**
+ * Descriptors of each type reserved per set in a pool. Tuned for sets that
+ * mostly hold buffers and a few textures, a pool short of one type just
+ * runs out early and is replaced.
+ */
+static const std::pair<VkDescriptorType, float> POOL_RATIOS[] = {
+  {VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+  {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f},
+  {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.0f},
+  {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f},
+  {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1.0f},
+  {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1.0f},
+  {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f},
+  {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+  {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+  {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f},
+  {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f}
+};
+
+struct ValiumDescriptorAllocator::impl {
+  /** Device the pools are created on */
+  VkDevice _device;
+
+  /** Cache the set layouts come from */
+  ValiumLayoutCache* _layoutCache;
+
+  /** Pools used by each frame in flight, the last one is allocated from */
+  std::vector<std::vector<VkDescriptorPool>> _frames;
+
+  /** Reset pools waiting to be reused by any frame */
+  std::vector<VkDescriptorPool> _free;
+
+  /** Frame sets are currently allocated for */
+  uint32_t _frame = 0;
+
+  /** Sets the next created pool holds */
+  uint32_t _setsPerPool = DESCRIPTOR_POOL_SETS;
+
+  /** Number of pools created */
+  size_t _poolCount = 0;
+
+  /** Guards everything above */
+  std::mutex _mutex;
+
+  /**
+   * Returns a recycled pool, or creates one larger than the last
+   */
+  VkDescriptorPool _GetPool();
+
+  /**
+   * Creates a pool larger than the last, holding at least @a required
+   * descriptors of each type on top of the usual ratios
+   */
+  VkDescriptorPool _CreatePool(const std::vector<VkDescriptorPoolSize>& required);
+};
+
+ValiumDescriptorAllocator::ValiumDescriptorAllocator(VkDevice device, ValiumLayoutCache* layoutCache, uint32_t framesInFlight) {
+  _impl = new impl();
+  _impl->_device = device;
+  _impl->_layoutCache = layoutCache;
+  _impl->_frames.resize(framesInFlight);
+}
+
+ValiumDescriptorAllocator::~ValiumDescriptorAllocator() {
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying " << _impl->_poolCount << " descriptor pools" << std::endl;
+#endif
+  for (auto& frame : _impl->_frames) {
+    for (VkDescriptorPool pool : frame) {
+      vkDestroyDescriptorPool(_impl->_device, pool, nullptr);
+    }
+  }
+  for (VkDescriptorPool pool : _impl->_free) {
+    vkDestroyDescriptorPool(_impl->_device, pool, nullptr);
+  }
+  delete _impl;
+}
+
+VkDescriptorPool ValiumDescriptorAllocator::impl::_GetPool() {
+  if (!_free.empty()) {
+    VkDescriptorPool pool = _free.back();
+    _free.pop_back();
+    return pool;
+  }
+  return _CreatePool({});
+}
+
+VkDescriptorPool ValiumDescriptorAllocator::impl::_CreatePool(const std::vector<VkDescriptorPoolSize>& required) {
+  std::map<VkDescriptorType, uint32_t> counts;
+  for (const auto& ratio : POOL_RATIOS) {
+    counts[ratio.first] = std::max(1u, static_cast<uint32_t>(ratio.second * _setsPerPool));
+  }
+  for (const VkDescriptorPoolSize& size : required) {
+    counts[size.type] = std::max(counts[size.type], size.descriptorCount);
+  }
+  std::vector<VkDescriptorPoolSize> sizes;
+  for (const auto& count : counts) {
+    sizes.push_back({count.first, count.second});
+  }
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  // No FREE_DESCRIPTOR_SET_BIT, sets only go away with a pool reset
+  poolInfo.flags = 0;
+  poolInfo.maxSets = _setsPerPool;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(sizes.size());
+  poolInfo.pPoolSizes = sizes.data();
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating descriptor pool of " << _setsPerPool << " sets" << std::endl;
+#endif
+  VkDescriptorPool pool;
+  if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor pool!");
+  }
+
+  _poolCount++;
+  _setsPerPool = std::min<uint32_t>(_setsPerPool * 2, DESCRIPTOR_POOL_MAX_SETS);
+  return pool;
+}
+
+void ValiumDescriptorAllocator::BeginFrame(uint32_t frame) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  _impl->_frame = frame;
+
+  // One reset per pool returns every set the frame allocated
+  for (VkDescriptorPool pool : _impl->_frames[frame]) {
+    vkResetDescriptorPool(_impl->_device, pool, 0);
+    _impl->_free.push_back(pool);
+  }
+  _impl->_frames[frame].clear();
+}
+
+VkDescriptorSet ValiumDescriptorAllocator::Allocate(VkDescriptorSetLayout layout) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  std::vector<VkDescriptorPool>& pools = _impl->_frames[_impl->_frame];
+  if (pools.empty()) {
+    pools.push_back(_impl->_GetPool());
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  VkDescriptorSet set;
+  allocInfo.descriptorPool = pools.back();
+  VkResult result = vkAllocateDescriptorSets(_impl->_device, &allocInfo, &set);
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    // The full pool stays with the frame until its next reset
+    pools.push_back(_impl->_GetPool());
+    allocInfo.descriptorPool = pools.back();
+    result = vkAllocateDescriptorSets(_impl->_device, &allocInfo, &set);
+  }
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    // The layout needs more descriptors of a type than the ratios give a
+    // whole pool, so size one from its bindings
+    pools.push_back(_impl->_CreatePool(_impl->_layoutCache->GetDescriptorCounts(layout)));
+    allocInfo.descriptorPool = pools.back();
+    result = vkAllocateDescriptorSets(_impl->_device, &allocInfo, &set);
+  }
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate descriptor set!");
+  }
+  return set;
+}
+
+VkDescriptorSet ValiumDescriptorAllocator::Allocate(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+  return Allocate(_impl->_layoutCache->GetSetLayout(bindings));
+}
+
+size_t ValiumDescriptorAllocator::GetPoolCount() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  return _impl->_poolCount;
+}
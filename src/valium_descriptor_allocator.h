@@ -0,0 +1,69 @@
+#pragma once
+
+#include "valium_layout_cache.h"
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/**
+ * Hands out descriptor sets that live for one frame in flight.
+ *
+ * Sets are never freed one by one. Each frame in flight allocates from its
+ * own descriptor pools, and BeginFrame() resets every pool of the frame at
+ * once, so per draw sets cost a pool allocation and nothing to release.
+ * A pool that runs out is replaced by a fresh one, each new pool holding
+ * twice the sets of the last up to DESCRIPTOR_POOL_MAX_SETS, and reset
+ * pools are recycled instead of destroyed. A set that needs more
+ * descriptors of a type than a whole pool holds gets a pool sized from
+ * its layout's bindings.
+ *
+ * Set layouts come from a ValiumLayoutCache, so identical bindings share
+ * one layout. Safe to use from several threads.
+ */
+class ValiumDescriptorAllocator
+{
+ public:
+  /**
+   * @param[in] device Device to create the pools on
+   * @param[in] layoutCache Cache the set layouts of Allocate() come from
+   * @param[in] framesInFlight Number of frames that may be in flight at once
+   */
+  ValiumDescriptorAllocator(VkDevice device, ValiumLayoutCache* layoutCache, uint32_t framesInFlight);
+
+  /**
+   * Destroys every pool, freeing every set handed out
+   */
+  ~ValiumDescriptorAllocator();
+
+  /**
+   * Resets @a frame's pools, invalidating the sets allocated for it, and
+   * makes it the frame Allocate() hands sets out for.
+   * Sets come from frame 0 before the first call.
+   *
+   * @note The frame's previous submission must have completed, wait on its fence first.
+   */
+  void BeginFrame(uint32_t frame);
+
+  /**
+   * Allocates a set for the current frame
+   *
+   * @param[in] layout Layout of the set, from the allocator's ValiumLayoutCache
+   * @returns a set valid until the frame's next BeginFrame()
+   */
+  VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+  /**
+   * Allocates a set for the current frame with the cached layout of @a bindings
+   *
+   * @param[in] bindings Bindings of the set, sorted by binding number
+   */
+  VkDescriptorSet Allocate(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+  /**
+   * @returns the number of descriptor pools created so far
+   */
+  size_t GetPoolCount();
+
+ private:
+  struct impl;
+  impl* _impl;
+};
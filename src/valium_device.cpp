@@ -2,12 +2,33 @@
 #include "valium_queue.h"
 #include "validation_layers.h"
 #include "valium_swapchain.h"
+#include "valium_offscreen.h"
 #include "valium_graphics.h"
 #include "valium_command_pool.h"
+#include "valium_frame_sync.h"
+#include "valium_pipeline_cache.h"
+#include "valium_pipeline_compiler.h"
+#include "valium_pipeline_registry.h"
+#include "valium_shader_cache.h"
+#include "valium_layout_cache.h"
+#include "valium_allocator.h"
+#include "valium_uploader.h"
+#include "valium_uniform_ring.h"
+#include "valium_descriptor_allocator.h"
+#include "valium_bindless.h"
+#include "valium_indirect.h"
+#include "valium_thread_pool.h"
+#include "valium_embedded_shaders.h"
 #include <vector>
 #include <iostream>
 #include <string>
 #include <set>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+#include "app_config.h"
 
 const std::vector<const char*> requiredDeviceExtensions = {
   VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -17,6 +38,8 @@ const std::vector<const char*> requiredDeviceExtensions = {
  * Private functions for ValiumDevice
  */
 struct ValiumDevice::ValiumDeviceImpl {
+  /** Instance the physical device belongs to, used to load extension functions */
+  const VkInstance instance;
   /** Represents the physical device for this @a ValiumDevice */
   const VkPhysicalDevice physicalDevice;
   /** Surface that will be rendered to */
@@ -25,31 +48,122 @@ struct ValiumDevice::ValiumDeviceImpl {
   /** Logical Device to be used with the vulkan API */
   VkDevice device;
 
-  /** Queue descriptor for interfacing with the GPU's command queue */
-  VkQueue graphicsQueue;
+  /**
+   * Queues created on each family, highest priority first.
+   * Initialized with CreateLogicalDevice()
+   */
+  std::map<uint32_t, std::vector<ValiumQueueHandle*>> queues;
+
+  /** First queue of the graphics family, frames are submitted to it */
+  ValiumQueueHandle* graphicsQueue = nullptr;
 
   /** Cached queue information. Cached during CreateLogicalDevice() */
   QueueFamilyIndices _indices;
 
-  /** Swapchain created for this device */
+  /** Sub-allocates every buffer and image's memory on this device */
+  ValiumAllocator* allocator = nullptr;
+
+  /** Copies data into device local buffers, batched once per frame */
+  ValiumUploader* uploader = nullptr;
+
+  /** Per frame uniform data, rewound when each frame's fence signals */
+  ValiumUniformRing* uniformRing = nullptr;
+
+  /** Vertices of the quad drawn with ValiumOptions::drawMesh */
+  ValiumBuffer* vertexBuffer = nullptr;
+
+  /** Indices of the quad drawn with ValiumOptions::drawMesh */
+  ValiumBuffer* indexBuffer = nullptr;
+
+  /** Culls and draws the grid of ValiumOptions::indirectDraws quads, nullptr if not used */
+  ValiumIndirectDraws* indirect = nullptr;
+
+  /** True if CreateLogicalDevice() enabled the multiDrawIndirect feature */
+  bool multiDrawIndirect = false;
+
+  /** True if CreateLogicalDevice() enabled VK_KHR_draw_indirect_count */
+  bool drawIndirectCount = false;
+
+  /** Swapchain created for this device. nullptr when running headless */
   ValiumSwapchain* swapchain = nullptr;
 
+  /** Images rendered to in place of the swapchain when running headless */
+  ValiumOffscreen* offscreen = nullptr;
+
   /** The command pool for submitting commands to vulkan */
   ValiumCommandPool* commandPool = nullptr;
 
+  /** Threads recording secondary command buffers, nullptr when recording on the render thread */
+  ValiumThreadPool* recordWorkers = nullptr;
+
+  /** Pipeline cache shared by every pipeline on this device */
+  ValiumPipelineCache* pipelineCache = nullptr;
+
+  /** Shader modules shared by every pipeline on this device */
+  ValiumShaderCache* shaderCache = nullptr;
+
+  /** Descriptor set and pipeline layouts shared by every pipeline on this device */
+  ValiumLayoutCache* layoutCache = nullptr;
+
+  /** Per frame descriptor sets, with layouts from @a layoutCache */
+  ValiumDescriptorAllocator* descriptorAllocator = nullptr;
+
+  /** Sampled images and storage buffers indexed by shaders, nullptr unless bindless is enabled */
+  ValiumBindlessTable* bindless = nullptr;
+
+  /** Descriptor indexing features enabled on the device, chained into its create info */
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+
+  /** True if CreateLogicalDevice() enabled descriptor indexing */
+  bool descriptorIndexing = false;
+
+  /** Compiles pipelines off the render thread, shares @a pipelineCache */
+  ValiumPipelineCompiler* pipelineCompiler = nullptr;
+
+  /** Every pipeline on this device, keyed by its state */
+  ValiumPipelineRegistry* pipelineRegistry = nullptr;
+
+  /** Semaphores and fences for each frame in flight */
+  ValiumFrameSync* frameSync = nullptr;
+
+  /** Options Valium was constructed with */
+  const ValiumOptions options;
+
+  /** Index of the frame in flight that DrawFrame() will record next */
+  uint32_t currentFrame = 0;
+
+  /**
+   * Fence of the frame that last rendered to each swapchain image.
+   * Used to avoid rendering to an image an older frame is still using when
+   * there are fewer images than frames in flight, or images come back out of order.
+   */
+  std::vector<VkFence> imagesInFlight;
+
   /**
    * @brief Queue that manages rendering contents to the window.
    * Initialized with CreateLogicalDevice()
    */
-  VkQueue presentQueue;
+  ValiumQueueHandle* presentQueue = nullptr;
+
+  /** First queue of the dedicated transfer family, or the graphics queue if there is none */
+  ValiumQueueHandle* transferQueue = nullptr;
 
   ValiumGraphics* pipeline;
 
+  /** Bumped whenever static command buffers need to be re-recorded */
+  uint64_t sceneGeneration = 1;
+
+  /** Scene generation each image's static command buffer was recorded at */
+  std::vector<uint64_t> staticGenerations;
+
+  /** Pipeline each image's static command buffer binds */
+  std::vector<VkPipeline> staticPipelines;
+
   /** Extensions to enable on the device */
   std::vector<const char*> desiredExtensions;
 
   /** Constructs and assigns the constant device */
-  ValiumDeviceImpl(const VkPhysicalDevice d, const VkSurfaceKHR surface) : physicalDevice(d), surface(surface) {}
+  ValiumDeviceImpl(const VkInstance instance, const VkPhysicalDevice d, const VkSurfaceKHR surface, const ValiumOptions& options) : instance(instance), physicalDevice(d), surface(surface), options(options) {}
 
   /** Creates the logical device around @a ValiumDeviceImpl::device */
   void CreateLogicalDevice();
@@ -59,6 +173,24 @@ struct ValiumDevice::ValiumDeviceImpl {
    */
   void SetExtensions(VkDeviceCreateInfo& createInfo);
 
+  /**
+   * Enables VK_EXT_descriptor_indexing and the features ValiumBindlessTable
+   * needs, if the device supports them all. Sets @a descriptorIndexing.
+   *
+   * @param[out] createInfo The struct to chain the features into
+   */
+  void EnableDescriptorIndexing(VkDeviceCreateInfo& createInfo);
+
+  /**
+   * Creates @a bindless sized to the device's update-after-bind limits
+   */
+  void CreateBindlessTable();
+
+  /**
+   * @returns the names of every extension the physical device supports
+   */
+  std::set<std::string> GetAvailableExtensions();
+
   /**
    * Creates the swapchain for this device.
    * @note Must be called after CreateLogicalDevice().
@@ -68,47 +200,171 @@ struct ValiumDevice::ValiumDeviceImpl {
   void CreateSwapchain(const uint32_t width, const uint32_t height);
 
   /**
-   * Initializes ValiumDeviceImpl::presentQueue.
+   * Creates the device owned images used in place of a swapchain.
+   * @note Must be called after CreateLogicalDevice().
+   * @param[in] width desired image width
+   * @param[in] height desired image height
+   */
+  void CreateOffscreen(const uint32_t width, const uint32_t height);
+
+  /**
+   * Returns true if there is no surface to present to
+   */
+  bool IsHeadless() const { return surface == VK_NULL_HANDLE; }
+
+  /**
+   * Describes ValiumOptions::queuePriorities.size() queues per family,
+   * fewer if the family doesn't have that many.
    * Called by CreateLogicalDevice()
    *
    * @param[in] indices QueueFamilyIndices object containing this device's queue info
-   * @param[out] queues Vector to be updated with desired queue results
-   * @param[in] priority Priority to use for all queues
+   * @param[out] desiredQueues Vector to be updated with desired queue results
    */
-  void GetDesiredQueues(QueueFamilyIndices indices, std::vector<VkDeviceQueueCreateInfo> &queues, float* priority);
+  void GetDesiredQueues(QueueFamilyIndices indices, std::vector<VkDeviceQueueCreateInfo> &desiredQueues);
+
+  /**
+   * Returns the family used for @a role
+   */
+  uint32_t GetRoleFamily(ValiumQueueRole role);
 
   /**
    * Creates the graphics pipeline on the device for managing shaders
    */
   void CreateGraphicsPipeline();
 
+  /**
+   * Creates the quad's vertex and index buffers and queues their upload
+   */
+  void CreateMesh();
+
+  /**
+   * Creates a grid of ValiumOptions::indirectDraws quads reaching past the
+   * edges of the view, and @a indirect to cull and draw them
+   */
+  void CreateIndirectScene();
+
   /**
    * Creates the command pool
    */
   void CreateCommandPool();
+
+  /**
+   * Creates the semaphores and fences for each frame in flight
+   */
+  void CreateFrameSync();
+
+  /**
+   * Returns the framebuffer for the image at @a index
+   */
+  VkFramebuffer GetFramebuffer(uint32_t index);
+
+  /**
+   * Records and submits the commands for the current frame into the image at @a imageIndex
+   *
+   * @param[in] imageIndex Image to render into
+   * @param[in] wait Semaphore to wait on before writing to the image, may be VK_NULL_HANDLE
+   */
+  void SubmitFrame(uint32_t imageIndex, VkSemaphore wait);
+
+  /**
+   * Records the frame's draws into a command buffer for this frame only
+   */
+  VkCommandBuffer RecordFrame(uint32_t imageIndex);
+
+  /**
+   * Returns the static command buffer of @a imageIndex, re-recording it
+   * first if the scene or the bound pipeline changed since it was recorded
+   */
+  VkCommandBuffer GetStaticFrame(uint32_t imageIndex);
 };
 
-ValiumDevice::ValiumDevice(const VkPhysicalDevice physicalDevice, const VkSurfaceKHR surface, const uint32_t width, const uint32_t height) {
-  _impl = new ValiumDeviceImpl(physicalDevice, surface);
+ValiumDevice::ValiumDevice(const VkInstance instance, const VkPhysicalDevice physicalDevice, const VkSurfaceKHR surface, const uint32_t width, const uint32_t height, const ValiumOptions& options) {
+  _impl = new ValiumDeviceImpl(instance, physicalDevice, surface, options);
   _impl->CreateLogicalDevice();
-  _impl->CreateSwapchain(width, height);
+  _impl->allocator = new ValiumAllocator(physicalDevice, _impl->device);
+  _impl->uploader = new ValiumUploader(_impl->allocator, _impl->device, _impl->_indices.transferOrGraphics(), _impl->_indices.graphicsFamily.value(), options.framesInFlight);
+  _impl->uniformRing = new ValiumUniformRing(_impl->allocator, physicalDevice, _impl->device, options.framesInFlight, UNIFORM_RING_SIZE);
+  if (_impl->IsHeadless()) {
+    _impl->CreateOffscreen(width, height);
+  } else {
+    _impl->CreateSwapchain(width, height);
+  }
+  _impl->pipelineCache = new ValiumPipelineCache(physicalDevice, _impl->device, options.pipelineCachePath);
+  _impl->shaderCache = new ValiumShaderCache(_impl->device);
+  _impl->layoutCache = new ValiumLayoutCache(_impl->device);
+  _impl->descriptorAllocator = new ValiumDescriptorAllocator(_impl->device, _impl->layoutCache, options.framesInFlight);
+  if (_impl->descriptorIndexing) {
+    _impl->CreateBindlessTable();
+  }
+  _impl->pipelineCompiler = new ValiumPipelineCompiler(_impl->device, _impl->pipelineCache->GetVkPipelineCache(), options.pipelineCompileThreads);
+  _impl->pipelineRegistry = new ValiumPipelineRegistry(_impl->pipelineCompiler);
+  if (options.indirectDraws > 0) {
+    _impl->CreateIndirectScene();
+  } else if (options.drawMesh) {
+    _impl->CreateMesh();
+  }
   _impl->CreateGraphicsPipeline();
-  _impl->swapchain->InitializeFramebuffers(_impl->pipeline->GetRenderPass());
+  if (_impl->IsHeadless()) {
+    _impl->offscreen->InitializeFramebuffers(_impl->pipeline->GetRenderPass());
+  } else {
+    _impl->swapchain->InitializeFramebuffers(_impl->pipeline->GetRenderPass());
+  }
   _impl->CreateCommandPool();
+  _impl->CreateFrameSync();
 #ifndef NDEBUG
   std::cout << "Created logical device" << std::endl;
 #endif
 }
 
 ValiumDevice::~ValiumDevice() {
+  // Nothing can be destroyed while frames are still executing
+  vkDeviceWaitIdle(_impl->device);
+#ifdef SHOW_RESOURCE_ALLOCATION
+  for (const ValiumHeapStats& heap : _impl->allocator->GetHeapStats()) {
+    std::cout << "Heap: " << heap.usedBytes << "/" << heap.reservedBytes << " bytes used in "
+              << heap.allocations << " allocations, " << heap.deviceAllocations << " device allocations, "
+              << "fragmentation " << heap.fragmentation << std::endl;
+  }
+#endif
+  delete _impl->frameSync;
+  delete _impl->recordWorkers;
+  delete _impl->commandPool;
+  // Queued compiles use the pipeline's render pass and layouts
+  _impl->pipelineCompiler->WaitIdle();
   delete _impl->pipeline;
+  delete _impl->indirect;
+  delete _impl->vertexBuffer;
+  delete _impl->indexBuffer;
+  delete _impl->uploader;
+  delete _impl->uniformRing;
+  delete _impl->pipelineRegistry;
+  delete _impl->pipelineCompiler;
+  delete _impl->shaderCache;
+  delete _impl->descriptorAllocator;
+  delete _impl->bindless;
+  delete _impl->layoutCache;
+  // Saves everything compiled this run for the next one
+  delete _impl->pipelineCache;
   delete _impl->swapchain;
+  delete _impl->offscreen;
+  // Everything allocated from it is gone by now
+  delete _impl->allocator;
+  for (auto& family : _impl->queues) {
+    for (ValiumQueueHandle* queue : family.second) {
+      delete queue;
+    }
+  }
   vkDestroyDevice(_impl->device, nullptr);
   delete _impl;
 }
 
 // static
-bool ValiumDevice::SupportsRequiredExtensions(VkPhysicalDevice device) {
+bool ValiumDevice::SupportsRequiredExtensions(VkPhysicalDevice device, VkSurfaceKHR surface) {
+  // Every required extension is for presenting, headless needs none of them
+  if (surface == VK_NULL_HANDLE) {
+    return true;
+  }
+
   // Get number of extensions
   uint32_t extensionCount;
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -141,14 +397,27 @@ void ValiumDevice::ValiumDeviceImpl::CreateLogicalDevice() {
   _indices = indices;
 
   std::vector<VkDeviceQueueCreateInfo> desiredQueues;
-  float priority = 1.0f;
-  GetDesiredQueues(indices, desiredQueues, &priority);
+  GetDesiredQueues(indices, desiredQueues);
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(desiredQueues.size());
   createInfo.pQueueCreateInfos = desiredQueues.data();
 
-  // Currently don't use any special device features
+  // Only the features the options need are enabled, extension features are chained in
   VkPhysicalDeviceFeatures deviceFeatures{};
   createInfo.pEnabledFeatures = &deviceFeatures;
+  if (options.bindless) {
+    EnableDescriptorIndexing(createInfo);
+  }
+  if (options.indirectDraws > 0) {
+    // Without these every culled slot is still drawn, one command per call
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supported);
+    deviceFeatures.multiDrawIndirect = supported.multiDrawIndirect;
+    multiDrawIndirect = supported.multiDrawIndirect == VK_TRUE;
+    if (GetAvailableExtensions().count(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) > 0) {
+      desiredExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+      drawIndirectCount = true;
+    }
+  }
 
 #ifndef NDEBUG
   createInfo.enabledLayerCount = ValidationLayers::validationLayers.size();
@@ -166,8 +435,18 @@ void ValiumDevice::ValiumDeviceImpl::CreateLogicalDevice() {
   }
 
   // Retrieve queues
-  vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-  vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+  for (const VkDeviceQueueCreateInfo& family : desiredQueues) {
+    for (uint32_t i = 0; i < family.queueCount; i++) {
+      VkQueue queue;
+      vkGetDeviceQueue(device, family.queueFamilyIndex, i, &queue);
+      queues[family.queueFamilyIndex].push_back(new ValiumQueueHandle(queue, family.queueFamilyIndex, family.pQueuePriorities[i]));
+    }
+  }
+  graphicsQueue = queues[indices.graphicsFamily.value()].front();
+  if (!IsHeadless()) {
+    presentQueue = queues[indices.presentFamily.value()].front();
+  }
+  transferQueue = queues[indices.transferOrGraphics()].front();
 }
 
 void ValiumDevice::ValiumDeviceImpl::SetExtensions(VkDeviceCreateInfo &createInfo) {
@@ -194,9 +473,11 @@ void ValiumDevice::ValiumDeviceImpl::SetExtensions(VkDeviceCreateInfo &createInf
     }
   }
 
-  // Add the required extensions to the list
-  for (auto ext : requiredDeviceExtensions) {
-    desiredExtensions.push_back(ext);
+  // Add the required extensions to the list, these are only needed for presenting
+  if (!IsHeadless()) {
+    for (auto ext : requiredDeviceExtensions) {
+      desiredExtensions.push_back(ext);
+    }
   }
 
   std::cout << "Requested extensions: " << std::endl;
@@ -207,42 +488,550 @@ void ValiumDevice::ValiumDeviceImpl::SetExtensions(VkDeviceCreateInfo &createInf
   createInfo.ppEnabledExtensionNames = desiredExtensions.data();
 }
 
-void ValiumDevice::ValiumDeviceImpl::GetDesiredQueues(QueueFamilyIndices indices, std::vector<VkDeviceQueueCreateInfo> &desiredQueues, float* priority) {
+void ValiumDevice::ValiumDeviceImpl::EnableDescriptorIndexing(VkDeviceCreateInfo& createInfo) {
+  // The instance stays at Vulkan 1.0, so features are queried through
+  // VK_KHR_get_physical_device_properties2, which Valium enables when present
+  auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+      vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+
+  std::set<std::string> available = GetAvailableExtensions();
+  if (getFeatures2 == nullptr || available.count(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0 ||
+      available.count(VK_KHR_MAINTENANCE3_EXTENSION_NAME) == 0) {
+    std::cout << "Descriptor indexing is not supported, bindless disabled" << std::endl;
+    return;
+  }
+
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported{};
+  supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2KHR features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+  features2.pNext = &supported;
+  getFeatures2(physicalDevice, &features2);
+
+  // Everything ValiumBindlessTable relies on, nothing more
+  if (!supported.runtimeDescriptorArray || !supported.descriptorBindingPartiallyBound ||
+      !supported.descriptorBindingUpdateUnusedWhilePending ||
+      !supported.descriptorBindingSampledImageUpdateAfterBind ||
+      !supported.descriptorBindingStorageBufferUpdateAfterBind ||
+      !supported.shaderSampledImageArrayNonUniformIndexing ||
+      !supported.shaderStorageBufferArrayNonUniformIndexing) {
+    std::cout << "Descriptor indexing features are missing, bindless disabled" << std::endl;
+    return;
+  }
+
+  indexingFeatures = {};
+  indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+  indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+  indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+  indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  indexingFeatures.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+  createInfo.pNext = &indexingFeatures;
+
+  desiredExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+  desiredExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+  descriptorIndexing = true;
+}
+
+std::set<std::string> ValiumDevice::ValiumDeviceImpl::GetAvailableExtensions() {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+  std::set<std::string> available;
+  for (const VkExtensionProperties& extension : extensions) {
+    available.insert(extension.extensionName);
+  }
+  return available;
+}
+
+void ValiumDevice::ValiumDeviceImpl::CreateBindlessTable() {
+  auto getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+      vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+
+  VkPhysicalDeviceDescriptorIndexingPropertiesEXT limits{};
+  limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+  VkPhysicalDeviceProperties2KHR properties2{};
+  properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+  properties2.pNext = &limits;
+  getProperties2(physicalDevice, &properties2);
+
+  // Every stage sees the table, so the per stage limits apply as well
+  uint32_t imageCount = std::min({BINDLESS_MAX_IMAGES,
+                                  limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                                  limits.maxPerStageDescriptorUpdateAfterBindSampledImages});
+  uint32_t bufferCount = std::min({BINDLESS_MAX_BUFFERS,
+                                   limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                   limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+  // Both bindings count against one per stage total, shared with the rest
+  // of the pipeline layout, so shrink them together to fit it
+  uint32_t maxResources = limits.maxPerStageUpdateAfterBindResources;
+  maxResources -= std::min(maxResources / 2, BINDLESS_RESERVED_RESOURCES);
+  if (static_cast<uint64_t>(imageCount) + bufferCount > maxResources) {
+    uint64_t total = static_cast<uint64_t>(imageCount) + bufferCount;
+    bufferCount = std::max<uint32_t>(1, static_cast<uint32_t>(bufferCount * static_cast<uint64_t>(maxResources) / total));
+    imageCount = maxResources - bufferCount;
+  }
+  bindless = new ValiumBindlessTable(device, imageCount, bufferCount, options.framesInFlight);
+}
+
+void ValiumDevice::ValiumDeviceImpl::GetDesiredQueues(QueueFamilyIndices indices, std::vector<VkDeviceQueueCreateInfo> &desiredQueues) {
+  if (options.queuePriorities.empty()) {
+    throw std::runtime_error("at least one queue priority is required!");
+  }
+  for (float priority : options.queuePriorities) {
+    if (priority < 0.0f || priority > 1.0f) {
+      throw std::runtime_error("queue priorities must be between 0 and 1!");
+    }
+  }
+
   // Place the queue families into a set (in case they're the same
   // queue index, we should only create queue once).
   std::set<uint32_t> uniqueQueueFamilies = {
-    indices.graphicsFamily.value(),
-    indices.presentFamily.value()
+    indices.graphicsFamily.value()
   };
+  if (indices.presentFamily.has_value()) {
+    uniqueQueueFamilies.insert(indices.presentFamily.value());
+  }
+  if (indices.transferFamily.has_value()) {
+    uniqueQueueFamilies.insert(indices.transferFamily.value());
+  }
+  if (indices.computeFamily.has_value()) {
+    uniqueQueueFamilies.insert(indices.computeFamily.value());
+  }
+
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
 
   // Create the queue creation structs and add them to the
   // desired queues
-  std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
+    uint32_t queueCount = std::min(static_cast<uint32_t>(options.queuePriorities.size()), families[queueFamily].queueCount);
 #ifdef SHOW_QUEUE_CREATION
-    std::cout << "Attempting to create queue " << queueFamily << std::endl;
+    std::cout << "Attempting to create " << queueCount << " queues on family " << queueFamily << std::endl;
 #endif
     VkDeviceQueueCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     createInfo.queueFamilyIndex = queueFamily;
-    createInfo.queueCount = 1;
-    createInfo.pQueuePriorities = priority;
+    createInfo.queueCount = queueCount;
+    createInfo.pQueuePriorities = options.queuePriorities.data();
     desiredQueues.push_back(createInfo);
   }
 }
 
+uint32_t ValiumDevice::ValiumDeviceImpl::GetRoleFamily(ValiumQueueRole role) {
+  switch (role) {
+    case ValiumQueueRole::Present:
+      if (IsHeadless()) {
+        throw std::runtime_error("headless devices have no present queue!");
+      }
+      return _indices.presentFamily.value();
+    case ValiumQueueRole::Transfer:
+      return _indices.transferOrGraphics();
+    case ValiumQueueRole::Compute:
+      return _indices.computeOrGraphics();
+    case ValiumQueueRole::Graphics:
+    default:
+      return _indices.graphicsFamily.value();
+  }
+}
+
 void ValiumDevice::ValiumDeviceImpl::CreateSwapchain(const uint32_t width, const uint32_t height) {
   swapchain = new ValiumSwapchain(physicalDevice, surface, device);
-  swapchain->InitializeSwapchain(width, height);
+  swapchain->InitializeSwapchain(width, height, options.presentPolicy);
+}
+
+void ValiumDevice::ValiumDeviceImpl::CreateOffscreen(const uint32_t width, const uint32_t height) {
+  // One image per frame in flight. Waiting on a frame's fence then also
+  // guarantees its image is free to render into again.
+  offscreen = new ValiumOffscreen(allocator, device, width, height, options.framesInFlight);
 }
 
 void ValiumDevice::ValiumDeviceImpl::CreateGraphicsPipeline() {
-  pipeline = new ValiumGraphics(device, swapchain);
-  pipeline->LoadShader("shaders/vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-  pipeline->LoadShader("shaders/frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-  pipeline->InitializePipeline();
+  if (IsHeadless()) {
+    // Nothing presents these images, leave them ready to be copied out
+    pipeline = new ValiumGraphics(device, offscreen->GetExtent(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pipelineCache->GetVkPipelineCache(), shaderCache, layoutCache);
+  } else {
+    pipeline = new ValiumGraphics(device, swapchain->GetExtent(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, pipelineCache->GetVkPipelineCache(), shaderCache, layoutCache);
+  }
+  if (bindless != nullptr) {
+    pipeline->SetBindlessTable(bindless, BINDLESS_SET);
+  }
+  if (!options.staticCommandBuffers) {
+    // Ring slices and sets only live for one frame, static buffers outlive them
+    pipeline->SetUniformRing(uniformRing, descriptorAllocator);
+  }
+  if (options.drawMesh || indirect != nullptr) {
+    pipeline->LoadShader(ValiumEmbeddedShaders::MESH_VERT, VK_SHADER_STAGE_VERTEX_BIT);
+    if (options.hotReloadShaders) {
+      pipeline->LoadShader(FRAG_SHADER_FILE, VK_SHADER_STAGE_FRAGMENT_BIT);
+    } else {
+      pipeline->LoadShader(ValiumEmbeddedShaders::BAD_COLOR_FRAG, VK_SHADER_STAGE_FRAGMENT_BIT);
+    }
+    if (indirect != nullptr) {
+      // Each record draws one quad out of the shared buffers
+      pipeline->SetVertexBuffer(vertexBuffer, 0);
+      pipeline->SetIndexBuffer(indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+      pipeline->SetIndirectDraws(indirect);
+    } else {
+      pipeline->SetVertexBuffer(vertexBuffer, 4);
+      pipeline->SetIndexBuffer(indexBuffer, 6);
+    }
+    // Offset then scale, matching the push constant block of shaders/mesh.vert
+    const float transform[] = {0.0f, 0.0f, 1.0f};
+    pipeline->SetPushConstants(transform, sizeof(transform));
+  } else if (options.hotReloadShaders) {
+    pipeline->LoadShader(VERT_SHADER_FILE, VK_SHADER_STAGE_VERTEX_BIT);
+    pipeline->LoadShader(FRAG_SHADER_FILE, VK_SHADER_STAGE_FRAGMENT_BIT);
+  } else {
+    // Compiled into the binary by src/Makefile.am
+    pipeline->LoadShader(ValiumEmbeddedShaders::BAD_TRIANGLE_VERT, VK_SHADER_STAGE_VERTEX_BIT);
+    pipeline->LoadShader(ValiumEmbeddedShaders::BAD_COLOR_FRAG, VK_SHADER_STAGE_FRAGMENT_BIT);
+  }
+  // Frames only clear until the pipeline is ready instead of stalling startup
+  pipeline->InitializePipelineAsync(pipelineRegistry);
+  if (options.hotReloadShaders) {
+    pipeline->EnableHotReload(options.framesInFlight);
+  }
+}
+
+void ValiumDevice::ValiumDeviceImpl::CreateMesh() {
+  // Position then color, matching the inputs of shaders/mesh.vert
+  const float vertices[] = {
+    -0.5f, -0.5f,   1.0f, 0.0f, 0.0f,
+     0.5f, -0.5f,   0.0f, 1.0f, 0.0f,
+     0.5f,  0.5f,   0.0f, 0.0f, 1.0f,
+    -0.5f,  0.5f,   1.0f, 1.0f, 1.0f
+  };
+  const uint16_t indices[] = {
+    0, 1, 2, 2, 3, 0
+  };
+
+  vertexBuffer = new ValiumBuffer(allocator, device, sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  indexBuffer = new ValiumBuffer(allocator, device, sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+  // Copied in by the first frame's submission
+  uploader->Upload(vertexBuffer, vertices, sizeof(vertices));
+  uploader->Upload(indexBuffer, indices, sizeof(indices));
+}
+
+void ValiumDevice::ValiumDeviceImpl::CreateIndirectScene() {
+  uint32_t count = options.indirectDraws;
+  uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+  // The grid is wider than the view, so the quads around it get culled
+  float cell = 2.0f * INDIRECT_GRID_EXTENT / columns;
+  float half = cell * 0.4f;
+
+  // Position then color, matching the inputs of shaders/mesh.vert
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  std::vector<ValiumDrawRecord> records;
+  vertices.reserve(count * 4 * 5);
+  indices.reserve(count * 6);
+  records.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    float x = -INDIRECT_GRID_EXTENT + cell * (i % columns + 0.5f);
+    float y = -INDIRECT_GRID_EXTENT + cell * (i / columns + 0.5f);
+    float red = static_cast<float>(i % columns) / columns;
+    float green = static_cast<float>(i / columns) / columns;
+
+    uint32_t first = static_cast<uint32_t>(vertices.size() / 5);
+    const float corners[4][2] = {{-half, -half}, {half, -half}, {half, half}, {-half, half}};
+    for (const auto& corner : corners) {
+      vertices.insert(vertices.end(), {x + corner[0], y + corner[1], red, green, 1.0f});
+    }
+    ValiumDrawRecord record;
+    record.center[0] = x;
+    record.center[1] = y;
+    record.radius = half * std::sqrt(2.0f);
+    record.indexCount = 6;
+    record.firstIndex = static_cast<uint32_t>(indices.size());
+    records.push_back(record);
+    indices.insert(indices.end(), {first, first + 1, first + 2, first + 2, first + 3, first});
+  }
+
+  VkDeviceSize vertexBytes = vertices.size() * sizeof(float);
+  VkDeviceSize indexBytes = indices.size() * sizeof(uint32_t);
+  vertexBuffer = new ValiumBuffer(allocator, device, vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  indexBuffer = new ValiumBuffer(allocator, device, indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+  uploader->Upload(vertexBuffer, vertices.data(), vertexBytes);
+  uploader->Upload(indexBuffer, indices.data(), indexBytes);
+
+  indirect = new ValiumIndirectDraws(physicalDevice, device, allocator, uploader, shaderCache, layoutCache,
+                                     pipelineCache->GetVkPipelineCache(), drawIndirectCount, multiDrawIndirect);
+  indirect->SetDraws(records);
 }
 
 void ValiumDevice::ValiumDeviceImpl::CreateCommandPool() {
-  commandPool = new ValiumCommandPool(device, _indices);
+  commandPool = new ValiumCommandPool(device, _indices, options.framesInFlight, options.recordThreads);
+  if (options.recordThreads > 0) {
+    recordWorkers = new ValiumThreadPool(options.recordThreads);
+  }
+}
+
+void ValiumDevice::ValiumDeviceImpl::CreateFrameSync() {
+  frameSync = new ValiumFrameSync(device, options.framesInFlight);
+  if (!IsHeadless()) {
+    imagesInFlight.resize(swapchain->GetImageCount(), VK_NULL_HANDLE);
+    frameSync->SetImageCount(swapchain->GetImageCount());
+  }
+}
+
+VkFramebuffer ValiumDevice::ValiumDeviceImpl::GetFramebuffer(uint32_t index) {
+  if (IsHeadless()) {
+    return offscreen->GetFramebuffer(index);
+  }
+  return swapchain->GetFramebuffer(index);
+}
+
+bool ValiumDevice::DrawFrame() {
+  uint32_t frame = _impl->currentFrame;
+  _impl->frameSync->WaitForFrame(frame);
+  _impl->uploader->BeginFrame(frame);
+  _impl->uniformRing->BeginFrame(frame);
+  _impl->descriptorAllocator->BeginFrame(frame);
+  if (_impl->pipelineRegistry->ReleaseUnused(_impl->options.framesInFlight) > 0) {
+    // A static buffer recorded with a released pipeline can't be submitted again
+    _impl->sceneGeneration++;
+  }
+  if (_impl->bindless != nullptr) {
+    _impl->bindless->BeginFrame();
+  }
+  // Frame boundary, a rebuilt pipeline can't disturb a frame being recorded
+  if (_impl->pipeline->ApplyReload()) {
+    // The replaced pipeline is destroyed a few frames from now, so nothing
+    // recorded with it can be submitted again
+    _impl->sceneGeneration++;
+  }
+
+  uint32_t imageIndex = frame;
+  VkSemaphore imageAvailable = VK_NULL_HANDLE;
+  // Suboptimal images can still be rendered and presented, the swapchain
+  // is recreated after this frame.
+  bool swapchainCurrent = true;
+  if (!_impl->IsHeadless()) {
+    imageAvailable = _impl->frameSync->GetImageAvailable(frame);
+    VkResult result = _impl->swapchain->AcquireNextImage(imageAvailable, &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      // Nothing was acquired or submitted, the frame's fence is still signaled
+      return false;
+    } else if (result == VK_SUBOPTIMAL_KHR) {
+      swapchainCurrent = false;
+    } else if (result != VK_SUCCESS) {
+      throw std::runtime_error("failed to acquire swap chain image!");
+    }
+
+    // An older frame may still be rendering into this image
+    VkFence imageFence = _impl->imagesInFlight[imageIndex];
+    if (imageFence != VK_NULL_HANDLE) {
+      vkWaitForFences(_impl->device, 1, &imageFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    }
+    _impl->imagesInFlight[imageIndex] = _impl->frameSync->GetInFlightFence(frame);
+  }
+
+  _impl->SubmitFrame(imageIndex, imageAvailable);
+
+  _impl->currentFrame = (frame + 1) % _impl->frameSync->GetFrameCount();
+
+  if (!_impl->IsHeadless()) {
+    VkResult result = _impl->swapchain->Present(_impl->presentQueue, _impl->frameSync->GetRenderFinished(imageIndex), imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+      swapchainCurrent = false;
+    } else if (result != VK_SUCCESS) {
+      throw std::runtime_error("failed to present swap chain image!");
+    }
+  }
+
+  return swapchainCurrent;
+}
+
+void ValiumDevice::RecreateSwapchain(const uint32_t width, const uint32_t height) {
+  if (_impl->IsHeadless()) {
+    return;
+  }
+
+  // Old framebuffers and views may still be referenced by frames in flight
+  vkDeviceWaitIdle(_impl->device);
+
+  _impl->swapchain->Recreate(width, height);
+  // Static command buffers reference the old framebuffers
+  _impl->sceneGeneration++;
+  _impl->pipeline->SetExtent(_impl->swapchain->GetExtent());
+
+  // The image count may have changed, and no frame is using any image now
+  _impl->imagesInFlight.assign(_impl->swapchain->GetImageCount(), VK_NULL_HANDLE);
+  _impl->frameSync->SetImageCount(_impl->swapchain->GetImageCount());
+}
+
+VkCommandBuffer ValiumDevice::ValiumDeviceImpl::RecordFrame(uint32_t imageIndex) {
+  VkCommandBuffer buffer = commandPool->RecordCommand(currentFrame);
+  uploader->RecordAcquire(buffer);
+  if (recordWorkers != nullptr) {
+    pipeline->RecordDrawParallel(buffer, GetFramebuffer(imageIndex), commandPool, currentFrame, recordWorkers);
+  } else {
+    pipeline->RecordDraw(buffer, GetFramebuffer(imageIndex));
+  }
+  if (!IsHeadless()) {
+    swapchain->RecordRelease(buffer, imageIndex);
+  }
+  if (vkEndCommandBuffer(buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record command buffer!");
+  }
+  return buffer;
+}
+
+VkCommandBuffer ValiumDevice::ValiumDeviceImpl::GetStaticFrame(uint32_t imageIndex) {
+  if (imageIndex >= staticGenerations.size()) {
+    staticGenerations.resize(imageIndex + 1, 0);
+    staticPipelines.resize(imageIndex + 1, VK_NULL_HANDLE);
+  }
+
+  // A pipeline finishing its compile or being hot reloaded changes what
+  // the buffer should bind, even if the scene itself didn't change
+  VkPipeline bound = pipeline->GetDrawPipeline();
+  if (staticGenerations[imageIndex] == sceneGeneration && staticPipelines[imageIndex] == bound) {
+    return commandPool->GetStatic(imageIndex);
+  }
+
+  // The image's last frame has completed, DrawFrame() waited on its fence
+  VkCommandBuffer buffer = commandPool->RecordStatic(imageIndex);
+  pipeline->RecordDraw(buffer, GetFramebuffer(imageIndex));
+  if (!IsHeadless()) {
+    swapchain->RecordRelease(buffer, imageIndex);
+  }
+  if (vkEndCommandBuffer(buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record static command buffer!");
+  }
+
+  staticGenerations[imageIndex] = sceneGeneration;
+  staticPipelines[imageIndex] = bound;
+  return buffer;
+}
+
+void ValiumDevice::ValiumDeviceImpl::SubmitFrame(uint32_t imageIndex, VkSemaphore wait) {
+  VkCommandBuffer uploads = uploader->EndFrame();
+
+  std::vector<VkCommandBuffer> buffers;
+  if (options.staticCommandBuffers) {
+    // Acquires change with each frame's uploads, so they can't be baked in
+    if (uploader->HasGraphicsWork()) {
+      VkCommandBuffer acquire = commandPool->RecordCommand(currentFrame);
+      uploader->RecordAcquire(acquire);
+      if (vkEndCommandBuffer(acquire) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+      }
+      buffers.push_back(acquire);
+    }
+    buffers.push_back(GetStaticFrame(imageIndex));
+  } else {
+    buffers.push_back(RecordFrame(imageIndex));
+  }
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+  std::vector<VkSemaphore> waits;
+  std::vector<VkPipelineStageFlags> waitStages;
+  if (wait != VK_NULL_HANDLE) {
+    waits.push_back(wait);
+    waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  }
+  VkSemaphore uploadFinished = uploader->GetSemaphore();
+  if (uploads != VK_NULL_HANDLE && uploader->IsAsync()) {
+    // Waiting here also makes the frame's fence cover the transfer submission
+    waits.push_back(uploadFinished);
+    // Culling reads uploaded draw records in a compute pass before any vertex input
+    waitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+  }
+  submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waits.size());
+  submitInfo.pWaitSemaphores = waits.data();
+  submitInfo.pWaitDstStageMask = waitStages.data();
+  submitInfo.commandBufferCount = static_cast<uint32_t>(buffers.size());
+  submitInfo.pCommandBuffers = buffers.data();
+
+  // Headless frames are never presented, so nothing waits on render finished
+  VkSemaphore renderFinished = VK_NULL_HANDLE;
+  if (!IsHeadless()) {
+    // Per image, the image's next acquire proves its last present consumed it
+    renderFinished = frameSync->GetRenderFinished(imageIndex);
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &renderFinished;
+  }
+
+  // Only reset the fence once work is about to be submitted, so an exception
+  // above can't leave the frame waiting on a fence that is never signaled.
+  VkFence inFlight = frameSync->GetInFlightFence(currentFrame);
+  vkResetFences(device, 1, &inFlight);
+
+  std::vector<VkSubmitInfo> submits;
+  if (uploads != VK_NULL_HANDLE) {
+    VkSubmitInfo uploadInfo{};
+    uploadInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    uploadInfo.commandBufferCount = 1;
+    uploadInfo.pCommandBuffers = &uploads;
+
+    if (uploader->IsAsync()) {
+      // Runs on the copy engine while the graphics queue finishes earlier frames
+      uploadInfo.signalSemaphoreCount = 1;
+      uploadInfo.pSignalSemaphores = &uploadFinished;
+      if (transferQueue->Submit(1, &uploadInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit upload command buffer!");
+      }
+    } else {
+      // The frame's uploads go first in the same submission, so the frame's
+      // fence also covers the staging memory they read from
+      submits.push_back(uploadInfo);
+    }
+  }
+  submits.push_back(submitInfo);
+
+  if (graphicsQueue->Submit(static_cast<uint32_t>(submits.size()), submits.data(), inFlight) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit draw command buffer!");
+  }
+}
+
+ValiumAllocator* ValiumDevice::GetAllocator() {
+  return _impl->allocator;
+}
+
+ValiumQueueHandle* ValiumDevice::GetQueue(ValiumQueueRole role, uint32_t index) {
+  return _impl->queues.at(_impl->GetRoleFamily(role)).at(index);
+}
+
+uint32_t ValiumDevice::GetQueueCount(ValiumQueueRole role) {
+  return static_cast<uint32_t>(_impl->queues.at(_impl->GetRoleFamily(role)).size());
+}
+
+ValiumUploader* ValiumDevice::GetUploader() {
+  return _impl->uploader;
+}
+
+ValiumUniformRing* ValiumDevice::GetUniformRing() {
+  return _impl->uniformRing;
+}
+
+ValiumDescriptorAllocator* ValiumDevice::GetDescriptorAllocator() {
+  return _impl->descriptorAllocator;
+}
+
+ValiumBindlessTable* ValiumDevice::GetBindlessTable() {
+  return _impl->bindless;
+}
+
+std::vector<ValiumHeapStats> ValiumDevice::GetMemoryStats() {
+  return _impl->allocator->GetHeapStats();
+}
+
+void ValiumDevice::MarkSceneDirty() {
+  _impl->sceneGeneration++;
+}
+
+void ValiumDevice::WaitIdle() {
+  vkDeviceWaitIdle(_impl->device);
 }
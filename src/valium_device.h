@@ -1,6 +1,13 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include "valium_options.h"
+#include "valium_allocator.h"
+#include "valium_uploader.h"
+#include "valium_uniform_ring.h"
+#include "valium_descriptor_allocator.h"
+#include "valium_bindless.h"
+#include "valium_queue.h"
 
 /**
  * @brief Encapsulates a logical device to be used with Vulkan
@@ -17,21 +24,114 @@ class ValiumDevice
 public:
   /**
    * Creates a logical device to interface with the given physical @a device
+   * @param[in] instance Instance @a device was enumerated from
    * @param[in] device Reference to the physical vulkan device
-   * @param[in] surface Surface that this device will be drawing to
+   * @param[in] surface Surface that this device will be drawing to. When this is
+   *                    VK_NULL_HANDLE the device runs headless and renders into
+   *                    device owned images instead of a swapchain.
    * @param[in] width Surface width
    * @param[in] height Surface height
+   * @param[in] options Options Valium was constructed with
    **/
-  ValiumDevice(const VkPhysicalDevice device, const VkSurfaceKHR surface, const uint32_t width, const uint32_t height);
+  ValiumDevice(const VkInstance instance, const VkPhysicalDevice device, const VkSurfaceKHR surface, const uint32_t width, const uint32_t height, const ValiumOptions& options);
   ~ValiumDevice();
 
+  /**
+   * Records, submits and presents one frame.
+   *
+   * Only blocks if the frame slot being reused is still executing on the GPU,
+   * so up to ValiumOptions::framesInFlight frames may be queued at once.
+   *
+   * @returns false if the swapchain is out of date or suboptimal and should be
+   *          rebuilt with RecreateSwapchain() before the next frame.
+   */
+  bool DrawFrame();
+
+  /**
+   * Rebuilds the swapchain, its views and framebuffers at a new size.
+   * The logical device, renderpass and graphics pipeline are kept.
+   * Does nothing when running headless.
+   *
+   * @param[in] width New surface width
+   * @param[in] height New surface height
+   */
+  void RecreateSwapchain(const uint32_t width, const uint32_t height);
+
+  /**
+   * Makes the next frame drawn into each image re-record its static command
+   * buffer. Call whenever what is drawn changes, e.g. new geometry or
+   * viewport regions. Only needed with ValiumOptions::staticCommandBuffers.
+   */
+  void MarkSceneDirty();
+
+  /**
+   * Blocks until all submitted work on the device has completed
+   */
+  void WaitIdle();
+
+  /**
+   * @returns the allocator every buffer and image on this device draws its memory from
+   */
+  ValiumAllocator* GetAllocator();
+
+  /**
+   * Returns one of the queues used for @a role. Each family has up to
+   * ValiumOptions::queuePriorities.size() queues, index 0 has the highest
+   * priority and is the one frames are submitted to. Threads submitting
+   * through different handles never contend on a lock.
+   *
+   * Roles without a dedicated family share the graphics family's queues,
+   * so compare GetFamily() to know if ownership transfers are needed.
+   *
+   * @param[in] role What the queue will be used for
+   * @param[in] index Queue within the role's family, below GetQueueCount()
+   */
+  ValiumQueueHandle* GetQueue(ValiumQueueRole role, uint32_t index = 0);
+
+  /**
+   * @returns the number of queues created on the family used for @a role
+   */
+  uint32_t GetQueueCount(ValiumQueueRole role);
+
+  /**
+   * @returns the uploader that fills device local buffers. Uploads are
+   *          submitted with the next frame drawn.
+   */
+  ValiumUploader* GetUploader();
+
+  /**
+   * @returns the ring per draw uniform data is written to. Slices are valid
+   *          for the frame DrawFrame() records next.
+   */
+  ValiumUniformRing* GetUniformRing();
+
+  /**
+   * @returns the allocator for descriptor sets used by the frame DrawFrame()
+   *          records next. They are reset together once the frame completes.
+   */
+  ValiumDescriptorAllocator* GetDescriptorAllocator();
+
+  /**
+   * @returns the table of images and buffers shaders index at set
+   *          BINDLESS_SET, nullptr unless ValiumOptions::bindless was set
+   *          and the device supports descriptor indexing
+   */
+  ValiumBindlessTable* GetBindlessTable();
+
+  /**
+   * @returns usage and fragmentation of each memory heap, indexed by heap
+   */
+  std::vector<ValiumHeapStats> GetMemoryStats();
+
   /**
    * Checks if the device supports the default required extensions
    * for use with valium
    *
    * @param[in] device The device to check support on.
+   * @param[in] surface Surface that will be drawn to, VK_NULL_HANDLE if headless.
+   *                    Headless devices don't need the swapchain extension.
    */
-  static bool SupportsRequiredExtensions(VkPhysicalDevice device);
+  static bool SupportsRequiredExtensions(VkPhysicalDevice device, VkSurfaceKHR surface);
 
 private:
   struct ValiumDeviceImpl;
@@ -32,3 +32,22 @@ VkPipelineViewportStateCreateInfo ValiumFixedFnInfo::GetViewportStateCreateInfo(
 
   return viewportState;
 }
+
+VkPipelineViewportStateCreateInfo ValiumFixedFnInfo::GetDynamicViewportStateCreateInfo(uint32_t count) {
+  VkPipelineViewportStateCreateInfo viewportState{};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = count;
+  viewportState.pViewports = nullptr; // Dynamic
+  viewportState.scissorCount = count;
+  viewportState.pScissors = nullptr; // Dynamic
+
+  return viewportState;
+}
+
+VkViewport ValiumFixedFnInfo::GetViewport(VkRect2D region) {
+  VkViewport viewport = GetViewport(region.extent.width, region.extent.height);
+  viewport.x = (float) region.offset.x;
+  viewport.y = (float) region.offset.y;
+
+  return viewport;
+}
@@ -8,7 +8,7 @@
 namespace ValiumFixedFnInfo {
   /**
    * Specifies the format of the vertex buffers that will be passed to the pipeline.
-   * Note: At this stage there is no vertex input, so it is left empty.
+   * Left empty here, the bindings and attributes are reflected from the vertex shader.
    */
   const VkPipelineVertexInputStateCreateInfo VERTEX_INPUT_INFO {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
@@ -94,6 +94,24 @@ namespace ValiumFixedFnInfo {
     .blendConstants[3] = 0.0f  // Optional
   };
 
+  /**
+   * States set while recording instead of being baked into the pipeline.
+   * Lets one pipeline render at any extent, or into several viewports.
+   */
+  const VkDynamicState DYNAMIC_STATES[] = {
+    VK_DYNAMIC_STATE_VIEWPORT,
+    VK_DYNAMIC_STATE_SCISSOR
+  };
+
+  /**
+   * Dynamic state creation info for @a DYNAMIC_STATES
+   */
+  const VkPipelineDynamicStateCreateInfo DYNAMIC_STATE_INFO {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+    .dynamicStateCount = sizeof(DYNAMIC_STATES) / sizeof(DYNAMIC_STATES[0]),
+    .pDynamicStates = DYNAMIC_STATES
+  };
+
   /**
    * Creates a VkViewport with the given width/height parameters
    *
@@ -118,4 +136,19 @@ namespace ValiumFixedFnInfo {
    * @param[in] scissor A scissor created with GetScissor()
    */
   VkPipelineViewportStateCreateInfo GetViewportStateCreateInfo(VkViewport &viewport, VkRect2D &scissor);
+
+  /**
+   * Constructs viewport state for use with @a DYNAMIC_STATE_INFO.
+   * Only the counts are given, the viewports and scissors are set while recording.
+   *
+   * @param[in] count Number of viewports. More than 1 needs the multiViewport feature.
+   */
+  VkPipelineViewportStateCreateInfo GetDynamicViewportStateCreateInfo(uint32_t count);
+
+  /**
+   * Creates a viewport covering the given region of the framebuffer
+   *
+   * @param[in] region Region in pixels
+   */
+  VkViewport GetViewport(VkRect2D region);
 };
@@ -0,0 +1,112 @@
+#include "valium_frame_sync.h"
+#include <stdexcept>
+#include <vector>
+#include <limits>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+struct ValiumFrameSync::impl {
+  /** Device the sync objects were created on */
+  VkDevice _device;
+
+  /** Signaled by vkAcquireNextImageKHR, one per frame */
+  std::vector<VkSemaphore> _imageAvailable;
+
+  /** Signaled when rendering to an image finishes, one per swapchain image */
+  std::vector<VkSemaphore> _renderFinished;
+
+  /** Signaled when a frame's submission completes, one per frame */
+  std::vector<VkFence> _inFlight;
+
+  /**
+   * Creates one set of sync objects
+   */
+  void _CreateFrame();
+};
+
+ValiumFrameSync::ValiumFrameSync(VkDevice device, uint32_t framesInFlight) {
+  _impl = new impl();
+  _impl->_device = device;
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    _impl->_CreateFrame();
+  }
+}
+
+ValiumFrameSync::~ValiumFrameSync() {
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying frame sync objects" << std::endl;
+#endif
+  for (auto semaphore : _impl->_imageAvailable) {
+    vkDestroySemaphore(_impl->_device, semaphore, nullptr);
+  }
+  for (auto semaphore : _impl->_renderFinished) {
+    vkDestroySemaphore(_impl->_device, semaphore, nullptr);
+  }
+  for (auto fence : _impl->_inFlight) {
+    vkDestroyFence(_impl->_device, fence, nullptr);
+  }
+  delete _impl;
+}
+
+void ValiumFrameSync::impl::_CreateFrame() {
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  // Start signaled so the first frame doesn't wait forever
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  VkSemaphore imageAvailable;
+  VkFence inFlight;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating frame sync objects" << std::endl;
+#endif
+  if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &imageAvailable) != VK_SUCCESS ||
+      vkCreateFence(_device, &fenceInfo, nullptr, &inFlight) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create synchronization objects for a frame!");
+  }
+
+  _imageAvailable.push_back(imageAvailable);
+  _inFlight.push_back(inFlight);
+}
+
+VkSemaphore ValiumFrameSync::GetImageAvailable(uint32_t frame) {
+  return _impl->_imageAvailable.at(frame);
+}
+
+void ValiumFrameSync::SetImageCount(uint32_t imageCount) {
+  while (_impl->_renderFinished.size() > imageCount) {
+    vkDestroySemaphore(_impl->_device, _impl->_renderFinished.back(), nullptr);
+    _impl->_renderFinished.pop_back();
+  }
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  while (_impl->_renderFinished.size() < imageCount) {
+    VkSemaphore renderFinished;
+    if (vkCreateSemaphore(_impl->_device, &semaphoreInfo, nullptr, &renderFinished) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for an image!");
+    }
+    _impl->_renderFinished.push_back(renderFinished);
+  }
+}
+
+VkSemaphore ValiumFrameSync::GetRenderFinished(uint32_t imageIndex) {
+  return _impl->_renderFinished.at(imageIndex);
+}
+
+VkFence ValiumFrameSync::GetInFlightFence(uint32_t frame) {
+  return _impl->_inFlight.at(frame);
+}
+
+void ValiumFrameSync::WaitForFrame(uint32_t frame) {
+  VkFence fence = _impl->_inFlight.at(frame);
+  vkWaitForFences(_impl->_device, 1, &fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+}
+
+uint32_t ValiumFrameSync::GetFrameCount() {
+  return static_cast<uint32_t>(_impl->_inFlight.size());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/**
+ * Owns the synchronization objects for every frame in flight.
+ *
+ * Each frame gets a semaphore signaled when its image is available and a
+ * fence signaled when the GPU is done with its command buffer. Keeping
+ * several frames lets the CPU record frame N+1 while the GPU is still
+ * executing frame N.
+ *
+ * The semaphores presentation waits on belong to swapchain images instead.
+ * Nothing tells the CPU when the presentation engine has consumed one, only
+ * acquiring the same image again does, so a per frame semaphore could be
+ * signaled again while a present still waits on it.
+ */
+class ValiumFrameSync
+{
+ public:
+  /**
+   * Creates the semaphores and fences for @a framesInFlight frames.
+   * The fences start signaled so the first wait on each frame returns immediately.
+   *
+   * @param[in] device Device to create the objects on
+   * @param[in] framesInFlight Number of frames that may be in flight at once
+   */
+  ValiumFrameSync(VkDevice device, uint32_t framesInFlight);
+  ~ValiumFrameSync();
+
+  /**
+   * @returns The semaphore signaled when the frame's swapchain image is available
+   */
+  VkSemaphore GetImageAvailable(uint32_t frame);
+
+  /**
+   * Creates or destroys render finished semaphores to have one per
+   * swapchain image. None exist until the first call.
+   *
+   * @param[in] imageCount Number of images in the swapchain
+   * @note No submission or present may be using the semaphores
+   */
+  void SetImageCount(uint32_t imageCount);
+
+  /**
+   * @returns The semaphore signaled when rendering to the swapchain image has finished
+   */
+  VkSemaphore GetRenderFinished(uint32_t imageIndex);
+
+  /**
+   * @returns The fence signaled when the frame's submission has completed
+   */
+  VkFence GetInFlightFence(uint32_t frame);
+
+  /**
+   * Blocks until the GPU is done with the given frame's previous submission
+   */
+  void WaitForFrame(uint32_t frame);
+
+  /**
+   * @returns The number of frames in flight
+   */
+  uint32_t GetFrameCount();
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -1,11 +1,15 @@
 #include "valium_graphics.h"
 #include "valium_fixed_functions.h"
 #include "valium_renderpass.h"
-#include <fstream>
+#include "valium_shader_watcher.h"
 #include <vector>
-#if SHOW_RESOURCE_ALLOCATION
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
 #include <iostream>
-#endif
 
 /**
  * Encapsulates shader information needed for using a shader
@@ -13,14 +17,47 @@
  */
 struct ShaderInfo {
   /**
-   * Compiled and loaded vertex or fragment shader
+   * Compiled and loaded vertex or fragment shader. Owned by the shader cache.
    */
   VkShaderModule shader;
 
   /**
-   * Information for using the shader in the graphics pipeline
+   * Stage the shader runs in
+   */
+  VkShaderStageFlagBits stage;
+
+  /**
+   * File the shader was loaded from, empty if it was loaded from memory
    */
-  VkPipelineShaderStageCreateInfo createInfo;
+  std::string path;
+};
+
+/**
+ * A pipeline replaced by a hot reload, kept until no frame in flight uses it
+ */
+struct RetiredPipeline {
+  /** Handle keeping an asynchronously compiled pipeline alive */
+  ValiumPipelineHandle handle;
+
+  /** Synchronously compiled pipeline to destroy, may be VK_NULL_HANDLE */
+  VkPipeline pipeline;
+
+  /** Frame boundaries left before the pipeline is destroyed */
+  uint32_t framesLeft;
+};
+
+/**
+ * A descriptor set of the pipeline layout fed from the uniform ring
+ */
+struct UniformSet {
+  /** Layout of the set, every binding a dynamic uniform buffer */
+  VkDescriptorSetLayout layout;
+
+  /** Bindings of the set, sorted by binding number */
+  std::vector<VkDescriptorSetLayoutBinding> bindings;
+
+  /** Reflected block size of each binding, in the order of @a bindings */
+  std::vector<uint32_t> sizes;
 };
 
 struct ValiumGraphics::impl {
@@ -35,7 +72,7 @@ struct ValiumGraphics::impl {
   VkDevice _device;
 
   /**
-   * Stores the swapchain's extent
+   * Stores the extent of the images being rendered to
    */
   VkExtent2D _extent;
 
@@ -45,21 +82,219 @@ struct ValiumGraphics::impl {
   std::vector<ShaderInfo> _shaders;
 
   /**
-   * Pipeline layout used for specifying uniform values in the pipeline
+   * Pipeline layout used for specifying uniform values in the pipeline.
+   * Derived from the shaders and owned by @a _layoutCache.
    */
   VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
 
+  /**
+   * Push constant ranges of @a _pipelineLayout, reflected from the shaders
+   */
+  std::vector<VkPushConstantRange> _pushConstantRanges;
+
+  /**
+   * Push constant data recorded before every draw, see SetPushConstants()
+   */
+  std::vector<uint8_t> _pushConstants;
+
+  /**
+   * Creates and owns the pipeline and descriptor set layouts
+   */
+  ValiumLayoutCache* _layoutCache = nullptr;
+
+  /**
+   * True if @a _layoutCache was created by this pipeline
+   */
+  bool _ownsLayoutCache = false;
+
+  /**
+   * Pipeline from a ValiumPipelineRegistry. Only used after
+   * InitializePipelineAsync(), in place of @a _graphicsPipeline.
+   */
+  ValiumPipelineHandle _asyncPipeline;
+
+  /**
+   * Registry @a _asyncPipeline came from, used to rebuild it
+   */
+  ValiumPipelineRegistry* _registry = nullptr;
+
+  /**
+   * Hash of the current pipeline's description
+   */
+  uint64_t _pipelineId = 0;
+
+  /**
+   * ID of the last @a _asyncPipeline whose failed compile was reported,
+   * so a failure is printed once instead of every frame
+   */
+  uint64_t _reportedFailure = 0;
+
+  /**
+   * Rasterization, multisample and blend state of the pipeline
+   */
+  ValiumFixedFunctionState _fixedFunction;
+
+  /**
+   * Specialization constants of each stage. Guarded by @a _reloadMutex.
+   */
+  std::map<VkShaderStageFlagBits, ValiumSpecialization> _specializations;
+
+  /**
+   * Drawn with while the pipeline is compiling, may be nullptr
+   */
+  ValiumGraphics* _fallback = nullptr;
+
+  /**
+   * Cache used when compiling the pipeline. Owned by the device.
+   */
+  VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+
+  /**
+   * Creates and owns the shader modules in @a _shaders
+   */
+  ValiumShaderCache* _shaderCache = nullptr;
+
+  /**
+   * True if @a _shaderCache was created by this pipeline
+   */
+  bool _ownsShaderCache = false;
+
   /**
    * Stores the renderpass
    */
   ValiumRenderPass* _renderPass = nullptr;
 
   /**
-   * Reads a binary file into a char buffer
+   * When true the viewport and scissor are dynamic state set while recording,
+   * otherwise they're baked into the pipeline from @a _extent
+   */
+  bool _dynamicViewport = true;
+
+  /**
+   * Regions of the framebuffer to draw into, each with its own viewport and
+   * scissor. Empty means the whole framebuffer. Only used with @a _dynamicViewport.
+   */
+  std::vector<VkRect2D> _regions;
+
+  /** Vertex buffer bound to binding 0, nullptr to draw the shader's hardcoded triangle */
+  ValiumBuffer* _vertexBuffer = nullptr;
+
+  /** Vertices drawn from @a _vertexBuffer without an index buffer */
+  uint32_t _vertexCount = 3;
+
+  /** Index buffer, nullptr for non-indexed draws */
+  ValiumBuffer* _indexBuffer = nullptr;
+
+  /** Indices drawn from @a _indexBuffer */
+  uint32_t _indexCount = 0;
+
+  /** Type of the indices in @a _indexBuffer */
+  VkIndexType _indexType = VK_INDEX_TYPE_UINT16;
+
+  /** Culled and drawn in place of the geometry's single draw, nullptr for direct draws */
+  ValiumIndirectDraws* _indirect = nullptr;
+
+  /** Bound at @a _bindlessSet before every draw, nullptr if not used */
+  ValiumBindlessTable* _bindless = nullptr;
+
+  /** Set number @a _bindless is bound at */
+  uint32_t _bindlessSet = 0;
+
+  /** Uniform blocks are copied into it before every draw, nullptr if not used */
+  ValiumUniformRing* _uniformRing = nullptr;
+
+  /** Allocates the per frame sets pointing at @a _uniformRing */
+  ValiumDescriptorAllocator* _descriptors = nullptr;
+
+  /** Sets of @a _pipelineLayout fed from @a _uniformRing, keyed by set number */
+  std::map<uint32_t, UniformSet> _uniformSets;
+
+  /** Data of each uniform block keyed by set then binding, see SetUniformData() */
+  std::map<uint32_t, std::map<uint32_t, std::vector<uint8_t>>> _uniformData;
+
+  /**
+   * Begins the renderpass, clearing @a framebuffer
+   */
+  void _BeginRenderPass(VkCommandBuffer buffer, VkFramebuffer framebuffer, VkSubpassContents contents);
+
+  /**
+   * Picks the pipeline to draw with, this one's or the fallback's if this
+   * one isn't ready. @a pipeline is VK_NULL_HANDLE if neither is ready.
    *
-   * @param[in] filename Path to the file to read
+   * @returns the graphics whose geometry and viewport mode go with @a pipeline
+   */
+  impl* _GetDrawSource(VkPipeline* pipeline);
+
+  /**
+   * Returns the viewport regions to draw, empty if the viewport is baked
+   */
+  std::vector<VkRect2D> _GetRegions(bool dynamicViewport);
+
+  /**
+   * Binds @a pipeline and the geometry, then draws once per region, or once
+   * without viewport state if @a regions is empty
+   */
+  void _RecordRegions(VkCommandBuffer buffer, VkPipeline pipeline, const std::vector<VkRect2D>& regions);
+
+  /**
+   * Binds the geometry buffers into @a buffer
+   */
+  void _BindGeometry(VkCommandBuffer buffer);
+
+  /**
+   * Records one draw of the geometry into @a buffer
+   */
+  void _DrawGeometry(VkCommandBuffer buffer);
+
+  /**
+   * Pushes @a _pushConstants into each of the layout's push constant ranges
+   */
+  void _PushConstants(VkCommandBuffer buffer);
+
+  /**
+   * Copies @a _uniformData into the uniform ring and binds each of
+   * @a _uniformSets with the copies' dynamic offsets
+   */
+  void _BindUniforms(VkCommandBuffer buffer);
+
+  /**
+   * Watches the files in @a _shaders, nullptr unless hot reload is enabled
+   */
+  ValiumShaderWatcher* _watcher = nullptr;
+
+  /**
+   * Guards @a _shaders, @a _extent and the pending reload against the watcher thread
+   */
+  std::mutex _reloadMutex;
+
+  /**
+   * Shaders of the pipeline being compiled by a hot reload
+   */
+  std::vector<ShaderInfo> _pendingShaders;
+
+  /**
+   * Pipeline being compiled by a hot reload. Replaces @a _asyncPipeline
+   * in ApplyReload() once it is ready.
+   */
+  ValiumPipelineHandle _pendingPipeline;
+
+  /**
+   * Pipelines replaced by hot reloads that frames in flight may still use
+   */
+  std::vector<RetiredPipeline> _retired;
+
+  /**
+   * Every handle from _RequestPipeline() that was still compiling when it
+   * was last checked, including ones that were replaced since. Their
+   * compiles use @a _renderPass, so the destructor waits for all of them.
+   * Guarded by @a _reloadMutex.
+   */
+  std::vector<ValiumPipelineHandle> _compiling;
+
+  /**
+   * Number of frame boundaries a replaced pipeline is kept for
    */
-  std::vector<char> _ReadFile(const std::string& filename);
+  uint32_t _framesInFlight = 0;
 
   /**
    * Loads a compiled shader from the given file
@@ -69,40 +304,97 @@ struct ValiumGraphics::impl {
   void _LoadShader(const std::string& shader, VkShaderStageFlagBits type);
 
   /**
-   * Loads a shader module into the graphics pipeline
+   * Adds a loaded shader module to the pipeline's stages
    *
-   * @param[in] shader The shader being loaded
+   * @param[in] shaderModule Module owned by @a _shaderCache
    * @param[in] type Specifies if this is a vertex or fragment shader
    */
-  VkPipelineShaderStageCreateInfo _CreateShaderPipelineInfo(VkShaderModule shader, VkShaderStageFlagBits type);
+  void _AddShader(VkShaderModule shaderModule, VkShaderStageFlagBits type, const std::string& path);
 
   /**
-   * Creates the pipelineLayout info
+   * Reloads a changed shader and queues a rebuild of the pipeline.
+   * Runs on the watcher thread.
+   *
+   * @param[in] path The shader file that changed
    */
-  void _CreatePipelineLayout();
+  void _OnShaderChanged(const std::string& path);
+
+  /**
+   * Returns the pipeline layout matching the shaders' combined interface
+   *
+   * @param[in] reflection The merged reflection of every stage
+   * @param[out] uniformSets Set to the layout's sets fed from the uniform ring if not nullptr
+   */
+  VkPipelineLayout _CreatePipelineLayout(const ShaderReflection& reflection, std::map<uint32_t, UniformSet>* uniformSets);
+
+  /**
+   * Gets the pipeline for @a desc from @a _registry and tracks it in
+   * @a _compiling until its compile has finished
+   */
+  ValiumPipelineHandle _RequestPipeline(const ValiumPipelineDesc& desc);
+
+  /**
+   * Describes the pipeline for the given extent and shaders
+   *
+   * @param[out] pushConstants Set to the layout's push constant ranges if not nullptr
+   * @param[out] uniformSets Set to the layout's sets fed from the uniform ring if not nullptr
+   */
+  ValiumPipelineDesc _GetPipelineDesc(VkExtent2D extent, const std::vector<ShaderInfo>& shaders, std::vector<VkPushConstantRange>* pushConstants = nullptr, std::map<uint32_t, UniformSet>* uniformSets = nullptr);
 
   /**
    * Constructs the final graphics pipeline
    */
   void _CreateGraphicsPipeline(VkExtent2D extent);
+
+  /**
+   * Returns the pipeline to draw with, VK_NULL_HANDLE if none is ready.
+   * Reports a failed compile of @a _asyncPipeline the first time it is seen.
+   */
+  VkPipeline _GetReadyPipeline();
 };
 
-ValiumGraphics::ValiumGraphics(VkDevice device, ValiumSwapchain* swapchain) {
+ValiumGraphics::ValiumGraphics(VkDevice device, VkExtent2D extent, VkImageLayout finalLayout, VkPipelineCache cache, ValiumShaderCache* shaderCache, ValiumLayoutCache* layoutCache) {
   _impl = new impl();
   _impl->_device = device;
-  _impl->_extent = swapchain->GetExtent();
-  _impl->_CreatePipelineLayout();
-  _impl->_renderPass = new ValiumRenderPass(device);
+  _impl->_extent = extent;
+  _impl->_pipelineCache = cache;
+  _impl->_shaderCache = shaderCache;
+  if (shaderCache == nullptr) {
+    _impl->_shaderCache = new ValiumShaderCache(device);
+    _impl->_ownsShaderCache = true;
+  }
+  _impl->_layoutCache = layoutCache;
+  if (layoutCache == nullptr) {
+    _impl->_layoutCache = new ValiumLayoutCache(device);
+    _impl->_ownsLayoutCache = true;
+  }
+  _impl->_renderPass = new ValiumRenderPass(device, finalLayout);
 }
 
 ValiumGraphics::~ValiumGraphics() {
-  // Destroy the loaded shaders
-  for (auto shaderInfo : _impl->_shaders) {
-    vkDestroyShaderModule(_impl->_device, shaderInfo.shader, nullptr);
+  // Stop reloads first so nothing new gets queued
+  delete _impl->_watcher;
+
+  // A compile in progress still uses the shaders, layout and renderpass,
+  // including compiles whose handles were replaced while they were queued
+  for (const ValiumPipelineHandle& handle : _impl->_compiling) {
+    handle.Wait();
+  }
+
+  for (auto& retired : _impl->_retired) {
+    if (retired.pipeline != VK_NULL_HANDLE) {
+      vkDestroyPipeline(_impl->_device, retired.pipeline, nullptr);
+    }
   }
 
-  if (_impl->_pipelineLayout != VK_NULL_HANDLE) {
-    vkDestroyPipelineLayout(_impl->_device, _impl->_pipelineLayout, nullptr);
+  // The loaded shaders belong to the cache
+  if (_impl->_ownsShaderCache) {
+    delete _impl->_shaderCache;
+  }
+
+  // So does the pipeline layout
+  if (_impl->_ownsLayoutCache) {
+    delete _impl->_layoutCache;
   }
 
   delete _impl->_renderPass;
@@ -121,122 +413,597 @@ void ValiumGraphics::LoadShader(const std::string &shader, const VkShaderStageFl
   _impl->_LoadShader(shader, type);
 }
 
-void ValiumGraphics::impl::_LoadShader(const std::string& shader, VkShaderStageFlagBits type) {
-  // Get the file as a byte buffer
-  std::vector<char> code = _ReadFile(shader);
-
-  // Create the struct to create the shader
-  VkShaderModuleCreateInfo createInfo{};
-  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = code.size();
-  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+void ValiumGraphics::LoadShader(const uint32_t* code, size_t size, VkShaderStageFlagBits type) {
+  _impl->_AddShader(_impl->_shaderCache->GetModule(code, size), type, std::string());
+}
 
-  // Construct the shader
-  VkShaderModule shaderModule;
-  if (vkCreateShaderModule(_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create shader module!");
-  }
+void ValiumGraphics::impl::_LoadShader(const std::string& shader, VkShaderStageFlagBits type) {
+  _AddShader(_shaderCache->GetModule(shader), type, shader);
+}
 
-  auto info = _CreateShaderPipelineInfo(shaderModule, type);
+void ValiumGraphics::impl::_AddShader(VkShaderModule shaderModule, VkShaderStageFlagBits type, const std::string& path) {
   // Push the shader into stored memory
   ShaderInfo newShader;
   newShader.shader = shaderModule;
-  newShader.createInfo = info;
+  newShader.stage = type;
+  newShader.path = path;
 
   _shaders.push_back(newShader);
 }
 
-std::vector<char> ValiumGraphics::impl::_ReadFile(const std::string& filename) {
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-  if (!file.is_open()) {
-    throw std::runtime_error("failed to open file!");
+VkPipelineLayout ValiumGraphics::impl::_CreatePipelineLayout(const ShaderReflection& reflection, std::map<uint32_t, UniformSet>* uniformSets) {
+  // Set numbers index the layout array, unused numbers get an empty set
+  std::vector<VkDescriptorSetLayout> setLayouts;
+  uint32_t setCount = reflection.sets.empty() ? 0 : reflection.sets.rbegin()->first + 1;
+  if (_bindless != nullptr) {
+    setCount = std::max(setCount, _bindlessSet + 1);
+  }
+  if (uniformSets != nullptr) {
+    uniformSets->clear();
+  }
+  for (uint32_t set = 0; set < setCount; set++) {
+    auto bindings = reflection.sets.find(set);
+    if (_bindless != nullptr && set == _bindlessSet) {
+      // Runtime arrays reflect with no size, the table has the real layout
+      setLayouts.push_back(_bindless->GetSetLayout());
+    } else if (bindings == reflection.sets.end()) {
+      setLayouts.push_back(_layoutCache->GetSetLayout({}));
+    } else if (_uniformRing != nullptr && std::all_of(bindings->second.begin(), bindings->second.end(), [](const VkDescriptorSetLayoutBinding& binding) {
+                 return binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+               })) {
+      // Fed from the uniform ring, so every block is bound with a dynamic
+      // offset instead of a descriptor write per draw
+      UniformSet uniforms;
+      uniforms.bindings = bindings->second;
+      for (VkDescriptorSetLayoutBinding& binding : uniforms.bindings) {
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        uniforms.sizes.push_back(reflection.uniformSizes.at(set).at(binding.binding));
+      }
+      uniforms.layout = _layoutCache->GetSetLayout(uniforms.bindings);
+      setLayouts.push_back(uniforms.layout);
+      if (uniformSets != nullptr) {
+        (*uniformSets)[set] = uniforms;
+      }
+    } else {
+      setLayouts.push_back(_layoutCache->GetSetLayout(bindings->second));
+    }
   }
 
-  size_t fileSize = (size_t) file.tellg();
-  std::vector<char> buffer(fileSize);
+  return _layoutCache->GetPipelineLayout(setLayouts, reflection.pushConstants);
+}
 
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
-  file.close();
+ValiumPipelineDesc ValiumGraphics::impl::_GetPipelineDesc(VkExtent2D extent, const std::vector<ShaderInfo>& shaders, std::vector<VkPushConstantRange>* pushConstants, std::map<uint32_t, UniformSet>* uniformSets) {
+  ValiumPipelineDesc desc;
+  // Get the shader stages from the stored shader list
+  std::vector<const ShaderReflection*> reflections;
+  // Specialization constants may size arrays, so specialized stages are
+  // reflected again. Reserved so the pointers above stay valid.
+  std::vector<ShaderReflection> specialized;
+  specialized.reserve(shaders.size());
+  for (auto shader : shaders) {
+    ValiumShaderStage stage = {shader.stage, shader.shader, _shaderCache->GetHash(shader.shader), "main"};
+    auto specialization = _specializations.find(shader.stage);
+    if (specialization != _specializations.end()) {
+      stage.specialization = specialization->second;
+      specialized.push_back(_shaderCache->GetReflection(shader.shader, specialization->second));
+      reflections.push_back(&specialized.back());
+    } else {
+      reflections.push_back(&_shaderCache->GetReflection(shader.shader));
+    }
+    desc.stages.push_back(stage);
+  }
 
-  return buffer;
+  // Layout and vertex input come from the shaders instead of being written by hand
+  ShaderReflection reflection = ValiumReflection::Merge(reflections);
+  desc.fixedFunction = _fixedFunction;
+  desc.layout = _CreatePipelineLayout(reflection, uniformSets);
+  desc.layoutKey = _layoutCache->GetKey(desc.layout);
+  if (pushConstants != nullptr) {
+    *pushConstants = reflection.pushConstants;
+  }
+  desc.vertexAttributes = reflection.vertexAttributes;
+  if (!reflection.vertexAttributes.empty()) {
+    desc.vertexBindings.push_back({0, reflection.vertexStride, VK_VERTEX_INPUT_RATE_VERTEX});
+  }
+  desc.renderPass = _renderPass->GetVkRenderPass();
+  desc.renderPassKey = _renderPass->GetKey();
+  desc.subpass = 0;
+  desc.dynamicViewport = _dynamicViewport;
+  desc.extent = extent;
+  return desc;
 }
 
-VkPipelineShaderStageCreateInfo ValiumGraphics::impl::_CreateShaderPipelineInfo(VkShaderModule shader, VkShaderStageFlagBits type) {
-  VkPipelineShaderStageCreateInfo createInfo{};
-  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  createInfo.stage = type;
+void ValiumGraphics::impl::_CreateGraphicsPipeline(VkExtent2D extent) {
+#if SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating the graphics pipeline" << std::endl;
+#endif
+  ValiumPipelineDesc desc = _GetPipelineDesc(extent, _shaders, &_pushConstantRanges, &_uniformSets);
+  _pipelineLayout = desc.layout;
+  _pipelineId = desc.Hash();
+  _graphicsPipeline = ValiumPipelineCompiler::Compile(_device, _pipelineCache, desc);
+}
 
+VkPipeline ValiumGraphics::impl::_GetReadyPipeline() {
+  if (_graphicsPipeline != VK_NULL_HANDLE) {
+    return _graphicsPipeline;
+  }
+  if (_asyncPipeline.HasFailed()) {
+    // Drawing carries on with the fallback, a hot reload can still fix it
+    if (_reportedFailure != _asyncPipeline.GetId()) {
+      std::cerr << "Failed to build pipeline: " << _asyncPipeline.GetError() << std::endl;
+      _reportedFailure = _asyncPipeline.GetId();
+    }
+    return VK_NULL_HANDLE;
+  }
+  return _asyncPipeline.Get();
+}
 
-  createInfo.module = shader;
-  createInfo.pName = "main";
+void ValiumGraphics::InitializePipeline() {
+  _impl->_CreateGraphicsPipeline(_impl->_extent);
+}
 
-  return createInfo;
+void ValiumGraphics::InitializePipelineAsync(ValiumPipelineRegistry* registry) {
+  _impl->_registry = registry;
+  ValiumPipelineDesc desc = _impl->_GetPipelineDesc(_impl->_extent, _impl->_shaders, &_impl->_pushConstantRanges, &_impl->_uniformSets);
+  _impl->_pipelineLayout = desc.layout;
+  _impl->_asyncPipeline = _impl->_RequestPipeline(desc);
+  _impl->_pipelineId = _impl->_asyncPipeline.GetId();
 }
 
-void ValiumGraphics::impl::_CreatePipelineLayout() {
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 0; // Optional
-  pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-  pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-  pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+bool ValiumGraphics::IsPipelineReady() {
+  return _impl->_GetReadyPipeline() != VK_NULL_HANDLE;
+}
 
-  if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create pipeline layout!");
+ValiumPipelineDesc ValiumGraphics::GetPipelineDesc() {
+  return _impl->_GetPipelineDesc(_impl->_extent, _impl->_shaders);
+}
+
+void ValiumGraphics::SetFixedFunctionState(const ValiumFixedFunctionState& state) {
+  if (_impl->_graphicsPipeline != VK_NULL_HANDLE || _impl->_asyncPipeline.IsValid()) {
+    throw std::runtime_error("fixed function state must be set before the pipeline is initialized!");
   }
+  _impl->_fixedFunction = state;
 }
 
-void ValiumGraphics::impl::_CreateGraphicsPipeline(VkExtent2D extent) {
-  VkGraphicsPipelineCreateInfo pipelineInfo{};
-  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  // Get the shader stages from the stored shader list
-  std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
-  for (auto shader : _shaders) {
-    shaderStages.push_back(shader.createInfo);
+void ValiumGraphics::SetSpecialization(VkShaderStageFlagBits stage, const ValiumSpecialization& constants) {
+  if (_impl->_graphicsPipeline != VK_NULL_HANDLE) {
+    throw std::runtime_error("pipelines compiled in place can't change specialization!");
+  }
+
+  std::lock_guard<std::mutex> lock(_impl->_reloadMutex);
+  _impl->_specializations[stage] = constants;
+
+  // Switch variants. One requested before comes straight back from the
+  // registry, a new one compiles in the background.
+  if (_impl->_asyncPipeline.IsValid()) {
+    // The constants may size descriptor or uniform block arrays, so the
+    // layout and the ring-backed sets follow the variant
+    ValiumPipelineDesc desc = _impl->_GetPipelineDesc(_impl->_extent, _impl->_shaders, &_impl->_pushConstantRanges, &_impl->_uniformSets);
+    _impl->_pipelineLayout = desc.layout;
+    _impl->_asyncPipeline = _impl->_RequestPipeline(desc);
+    _impl->_pipelineId = _impl->_asyncPipeline.GetId();
+  }
+  if (_impl->_pendingPipeline.IsValid()) {
+    _impl->_pendingPipeline = _impl->_RequestPipeline(_impl->_GetPipelineDesc(_impl->_extent, _impl->_pendingShaders));
   }
-  pipelineInfo.stageCount = shaderStages.size();
-  pipelineInfo.pStages = shaderStages.data();
+}
 
-  pipelineInfo.pVertexInputState = &ValiumFixedFnInfo::VERTEX_INPUT_INFO;
-  pipelineInfo.pInputAssemblyState = &ValiumFixedFnInfo::VERTEX_ASSEMBLY_INFO;
+uint64_t ValiumGraphics::GetPipelineId() {
+  return _impl->_pipelineId;
+}
 
-  // Viewport State
-  VkViewport viewport = ValiumFixedFnInfo::GetViewport(extent.width, extent.height);
-  VkRect2D scissor = ValiumFixedFnInfo::GetScissor(extent);
-  VkPipelineViewportStateCreateInfo viewportStateCreateInfo = ValiumFixedFnInfo::GetViewportStateCreateInfo(viewport, scissor);
+void ValiumGraphics::SetFallback(ValiumGraphics* fallback) {
+  _impl->_fallback = fallback;
+}
+
+VkPipelineLayout ValiumGraphics::GetPipelineLayout() {
+  return _impl->_pipelineLayout;
+}
+
+ValiumRenderPass* ValiumGraphics::GetRenderPass() {
+  return _impl->_renderPass;
+}
 
-  pipelineInfo.pViewportState = &viewportStateCreateInfo;
+void ValiumGraphics::SetExtent(VkExtent2D extent) {
+  std::lock_guard<std::mutex> lock(_impl->_reloadMutex);
+  _impl->_extent = extent;
 
-  pipelineInfo.pRasterizationState = &ValiumFixedFnInfo::RASTERIZER_INFO;
-  pipelineInfo.pMultisampleState = &ValiumFixedFnInfo::MULTISAMPLING_INFO;
-  pipelineInfo.pDepthStencilState = nullptr; // Optional
-  pipelineInfo.pColorBlendState = &ValiumFixedFnInfo::COLOR_BLEND_INFO;
-  pipelineInfo.pDynamicState = nullptr; // Optional
+  // A baked viewport only fits the extent it was built with
+  if (!_impl->_dynamicViewport && _impl->_graphicsPipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(_impl->_device, _impl->_graphicsPipeline, nullptr);
+    _impl->_graphicsPipeline = VK_NULL_HANDLE;
+    _impl->_CreateGraphicsPipeline(extent);
+  } else if (!_impl->_dynamicViewport && _impl->_asyncPipeline.IsValid()) {
+    // The old pipeline may still be compiling against the same shaders,
+    // the destructor waits for it through @a _compiling
+    _impl->_asyncPipeline = _impl->_RequestPipeline(_impl->_GetPipelineDesc(extent, _impl->_shaders));
+    _impl->_pipelineId = _impl->_asyncPipeline.GetId();
+    if (_impl->_pendingPipeline.IsValid()) {
+      _impl->_pendingPipeline = _impl->_RequestPipeline(_impl->_GetPipelineDesc(extent, _impl->_pendingShaders));
+    }
+  }
+}
 
-  pipelineInfo.layout = _pipelineLayout;
-  pipelineInfo.renderPass = _renderPass->GetVkRenderPass();
-  pipelineInfo.subpass = 0;
+ValiumPipelineHandle ValiumGraphics::impl::_RequestPipeline(const ValiumPipelineDesc& desc) {
+  _compiling.erase(std::remove_if(_compiling.begin(), _compiling.end(), [](const ValiumPipelineHandle& handle) {
+    return handle.IsReady() || handle.HasFailed();
+  }), _compiling.end());
 
-  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-  pipelineInfo.basePipelineIndex = -1; // Optional
+  ValiumPipelineHandle handle = _registry->Get(desc);
+  if (!handle.IsReady() && !handle.HasFailed()) {
+    _compiling.push_back(handle);
+  }
+  return handle;
+}
 
-  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-  pipelineInfo.basePipelineIndex = -1; // Optional
+void ValiumGraphics::EnableHotReload(uint32_t framesInFlight) {
+  if (_impl->_registry == nullptr) {
+    throw std::runtime_error("hot reload needs the pipeline to be initialized asynchronously!");
+  }
+  if (_impl->_watcher != nullptr) {
+    return;
+  }
 
-#if SHOW_RESOURCE_ALLOCATION
-  std::cout << "Creating the graphics pipeline" << std::endl;
+  _impl->_framesInFlight = framesInFlight;
+  _impl->_watcher = new ValiumShaderWatcher([this](const std::string& path) {
+    _impl->_OnShaderChanged(path);
+  });
+  for (const ShaderInfo& shader : _impl->_shaders) {
+    if (!shader.path.empty()) {
+      _impl->_watcher->AddFile(shader.path);
+    }
+  }
+}
+
+void ValiumGraphics::impl::_OnShaderChanged(const std::string& path) {
+  std::vector<ShaderInfo> shaders;
+  {
+    // Build on top of a reload that is still compiling so no edit is lost
+    std::lock_guard<std::mutex> lock(_reloadMutex);
+    shaders = _pendingPipeline.IsValid() ? _pendingShaders : _shaders;
+  }
+
+  try {
+    for (ShaderInfo& shader : shaders) {
+      if (shader.path == path) {
+        shader.shader = _shaderCache->GetModule(path);
+      }
+    }
+  } catch (const std::exception& e) {
+    // Usually a shader that failed to compile, keep the current pipeline
+    std::cerr << "Failed to reload " << path << ": " << e.what() << std::endl;
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(_reloadMutex);
+#ifndef NDEBUG
+  std::cout << "Reloading " << path << std::endl;
 #endif
-  if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create graphics pipeline!");
+  _pendingShaders = shaders;
+  // An edit undone before the earlier pipeline is released gets it back from the registry
+  _pendingPipeline = _RequestPipeline(_GetPipelineDesc(_extent, shaders));
+}
+
+bool ValiumGraphics::ApplyReload() {
+  if (_impl->_watcher == nullptr) {
+    return false;
   }
+
+  // Every frame that could have used a retired pipeline has finished by now
+  for (auto it = _impl->_retired.begin(); it != _impl->_retired.end(); ) {
+    if (--it->framesLeft == 0) {
+      if (it->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(_impl->_device, it->pipeline, nullptr);
+      }
+      it = _impl->_retired.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_impl->_reloadMutex);
+  if (!_impl->_pendingPipeline.IsValid()) {
+    return false;
+  }
+  if (_impl->_pendingPipeline.HasFailed()) {
+    std::cerr << "Failed to rebuild pipeline: " << _impl->_pendingPipeline.GetError() << std::endl;
+    _impl->_pendingPipeline = ValiumPipelineHandle();
+    return false;
+  }
+  if (!_impl->_pendingPipeline.IsReady()) {
+    return false;
+  }
+
+  _impl->_retired.push_back({_impl->_asyncPipeline, _impl->_graphicsPipeline, _impl->_framesInFlight});
+  _impl->_graphicsPipeline = VK_NULL_HANDLE;
+  _impl->_asyncPipeline = _impl->_pendingPipeline;
+  _impl->_pendingPipeline = ValiumPipelineHandle();
+  _impl->_shaders = _impl->_pendingShaders;
+  _impl->_pipelineLayout = _impl->_GetPipelineDesc(_impl->_extent, _impl->_shaders, &_impl->_pushConstantRanges, &_impl->_uniformSets).layout;
+  _impl->_pipelineId = _impl->_asyncPipeline.GetId();
+  return true;
 }
 
-void ValiumGraphics::InitializePipeline() {
-  _impl->_CreateGraphicsPipeline(_impl->_extent);
+void ValiumGraphics::SetDynamicViewport(bool enabled) {
+  if (_impl->_graphicsPipeline != VK_NULL_HANDLE || _impl->_asyncPipeline.IsValid()) {
+    throw std::runtime_error("viewport mode must be chosen before the pipeline is initialized!");
+  }
+  _impl->_dynamicViewport = enabled;
 }
 
-ValiumRenderPass* ValiumGraphics::GetRenderPass() {
-  return _impl->_renderPass;
+void ValiumGraphics::SetViewportRegions(const std::vector<VkRect2D>& regions) {
+  _impl->_regions = regions;
+}
+
+void ValiumGraphics::SetBindlessTable(ValiumBindlessTable* table, uint32_t set) {
+  if (_impl->_graphicsPipeline != VK_NULL_HANDLE || _impl->_asyncPipeline.IsValid()) {
+    throw std::runtime_error("bindless table must be set before the pipeline is initialized!");
+  }
+  _impl->_bindless = table;
+  _impl->_bindlessSet = set;
+}
+
+void ValiumGraphics::SetUniformRing(ValiumUniformRing* ring, ValiumDescriptorAllocator* descriptors) {
+  if (_impl->_graphicsPipeline != VK_NULL_HANDLE || _impl->_asyncPipeline.IsValid()) {
+    throw std::runtime_error("uniform ring must be set before the pipeline is initialized!");
+  }
+  _impl->_uniformRing = ring;
+  _impl->_descriptors = descriptors;
+}
+
+void ValiumGraphics::SetUniformData(uint32_t set, uint32_t binding, const void* data, uint32_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  _impl->_uniformData[set][binding].assign(bytes, bytes + size);
+}
+
+void ValiumGraphics::SetIndirectDraws(ValiumIndirectDraws* draws) {
+  _impl->_indirect = draws;
+}
+
+void ValiumGraphics::SetPushConstants(const void* data, uint32_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  _impl->_pushConstants.assign(bytes, bytes + size);
+}
+
+void ValiumGraphics::SetVertexBuffer(ValiumBuffer* buffer, uint32_t vertexCount) {
+  _impl->_vertexBuffer = buffer;
+  _impl->_vertexCount = buffer != nullptr ? vertexCount : 3;
+}
+
+void ValiumGraphics::SetIndexBuffer(ValiumBuffer* buffer, uint32_t indexCount, VkIndexType indexType) {
+  _impl->_indexBuffer = buffer;
+  _impl->_indexCount = indexCount;
+  _impl->_indexType = indexType;
+}
+
+void ValiumGraphics::impl::_BindGeometry(VkCommandBuffer buffer) {
+  if (_vertexBuffer != nullptr) {
+    VkBuffer vertexBuffers[] = {_vertexBuffer->GetVkBuffer()};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
+  }
+  if (_indexBuffer != nullptr) {
+    vkCmdBindIndexBuffer(buffer, _indexBuffer->GetVkBuffer(), 0, _indexType);
+  }
+}
+
+void ValiumGraphics::impl::_DrawGeometry(VkCommandBuffer buffer) {
+  if (_indirect != nullptr) {
+    // Commands written by the culling pass recorded ahead of the renderpass
+    _indirect->RecordDraws(buffer);
+  } else if (_indexBuffer != nullptr) {
+    vkCmdDrawIndexed(buffer, _indexCount, 1, 0, 0, 0);
+  } else {
+    // Without a vertex buffer the triangle is hardcoded in the vertex shader
+    vkCmdDraw(buffer, _vertexCount, 1, 0, 0);
+  }
+}
+
+void ValiumGraphics::impl::_PushConstants(VkCommandBuffer buffer) {
+  for (const VkPushConstantRange& range : _pushConstantRanges) {
+    // Bytes never set are pushed as zero, so shaders never read undefined values
+    std::vector<uint8_t> data(range.size, 0);
+    if (range.offset < _pushConstants.size()) {
+      size_t count = std::min<size_t>(range.size, _pushConstants.size() - range.offset);
+      std::copy_n(_pushConstants.begin() + range.offset, count, data.begin());
+    }
+    vkCmdPushConstants(buffer, _pipelineLayout, range.stageFlags, range.offset, range.size, data.data());
+  }
+}
+
+void ValiumGraphics::impl::_BindUniforms(VkCommandBuffer buffer) {
+  for (const auto& set : _uniformSets) {
+    const UniformSet& uniforms = set.second;
+
+    size_t descriptorCount = 0;
+    for (const VkDescriptorSetLayoutBinding& binding : uniforms.bindings) {
+      descriptorCount += binding.descriptorCount;
+    }
+    // Writes point into the infos, so they can't reallocate
+    std::vector<VkDescriptorBufferInfo> infos;
+    infos.reserve(descriptorCount);
+    std::vector<VkWriteDescriptorSet> writes;
+    // Dynamic offsets are ordered by binding, then by array element
+    std::vector<uint32_t> offsets;
+
+    VkDescriptorSet descriptorSet = _descriptors->Allocate(uniforms.layout);
+    for (size_t i = 0; i < uniforms.bindings.size(); i++) {
+      const VkDescriptorSetLayoutBinding& binding = uniforms.bindings[i];
+      uint32_t size = uniforms.sizes[i];
+
+      // Array elements follow each other in the block's data
+      std::vector<uint8_t> data;
+      auto setData = _uniformData.find(set.first);
+      if (setData != _uniformData.end()) {
+        auto blockData = setData->second.find(binding.binding);
+        if (blockData != setData->second.end()) {
+          data = blockData->second;
+        }
+      }
+      data.resize(static_cast<size_t>(size) * binding.descriptorCount, 0);
+
+      VkWriteDescriptorSet write{};
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = descriptorSet;
+      write.dstBinding = binding.binding;
+      write.dstArrayElement = 0;
+      write.descriptorCount = binding.descriptorCount;
+      write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+      write.pBufferInfo = infos.data() + infos.size();
+      writes.push_back(write);
+
+      for (uint32_t element = 0; element < binding.descriptorCount; element++) {
+        infos.push_back(_uniformRing->GetDescriptorInfo(size));
+        offsets.push_back(_uniformRing->Push(data.data() + static_cast<size_t>(size) * element, size));
+      }
+    }
+
+    vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, set.first, 1, &descriptorSet, static_cast<uint32_t>(offsets.size()), offsets.data());
+  }
+}
+
+void ValiumGraphics::impl::_BeginRenderPass(VkCommandBuffer buffer, VkFramebuffer framebuffer, VkSubpassContents contents) {
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = _renderPass->GetVkRenderPass();
+  renderPassInfo.framebuffer = framebuffer;
+  renderPassInfo.renderArea.offset = {0, 0};
+  renderPassInfo.renderArea.extent = _extent;
+
+  VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+  renderPassInfo.clearValueCount = 1;
+  renderPassInfo.pClearValues = &clearColor;
+
+  vkCmdBeginRenderPass(buffer, &renderPassInfo, contents);
+}
+
+ValiumGraphics::impl* ValiumGraphics::impl::_GetDrawSource(VkPipeline* pipeline) {
+  // Never wait on a compile while recording, substitute or skip the draw
+  *pipeline = _GetReadyPipeline();
+  if (*pipeline == VK_NULL_HANDLE && _fallback != nullptr) {
+    // The fallback's vertex input may differ, so it draws its own geometry
+    *pipeline = _fallback->_impl->_GetReadyPipeline();
+    return _fallback->_impl;
+  }
+  return this;
+}
+
+std::vector<VkRect2D> ValiumGraphics::impl::_GetRegions(bool dynamicViewport) {
+  if (!dynamicViewport) {
+    // Baked into the pipeline, one draw without viewport state
+    return {};
+  }
+  std::vector<VkRect2D> regions = _regions;
+  if (regions.empty()) {
+    regions.push_back(ValiumFixedFnInfo::GetScissor(_extent));
+  }
+  return regions;
+}
+
+void ValiumGraphics::impl::_RecordRegions(VkCommandBuffer buffer, VkPipeline pipeline, const std::vector<VkRect2D>& regions) {
+  vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  if (_bindless != nullptr) {
+    VkDescriptorSet table = _bindless->GetDescriptorSet();
+    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, _bindlessSet, 1, &table, 0, nullptr);
+  }
+  _PushConstants(buffer);
+  _BindUniforms(buffer);
+  _BindGeometry(buffer);
+
+  if (regions.empty()) {
+    _DrawGeometry(buffer);
+  }
+
+  // Same pipeline for every region, only the dynamic state changes
+  for (const VkRect2D& region : regions) {
+    VkViewport viewport = ValiumFixedFnInfo::GetViewport(region);
+    vkCmdSetViewport(buffer, 0, 1, &viewport);
+    vkCmdSetScissor(buffer, 0, 1, &region);
+    _DrawGeometry(buffer);
+  }
+}
+
+VkPipeline ValiumGraphics::GetDrawPipeline() {
+  VkPipeline pipeline;
+  _impl->_GetDrawSource(&pipeline);
+  return pipeline;
+}
+
+void ValiumGraphics::RecordDraw(VkCommandBuffer buffer, VkFramebuffer framebuffer) {
+  VkPipeline pipeline;
+  impl* source = _impl->_GetDrawSource(&pipeline);
+  // Compute can't run inside a renderpass
+  if (pipeline != VK_NULL_HANDLE && source->_indirect != nullptr) {
+    source->_indirect->RecordCull(buffer);
+  }
+
+  _impl->_BeginRenderPass(buffer, framebuffer, VK_SUBPASS_CONTENTS_INLINE);
+  if (pipeline != VK_NULL_HANDLE) {
+    source->_RecordRegions(buffer, pipeline, _impl->_GetRegions(source->_dynamicViewport));
+  }
+
+  vkCmdEndRenderPass(buffer);
+}
+
+void ValiumGraphics::RecordDrawParallel(VkCommandBuffer buffer, VkFramebuffer framebuffer, ValiumCommandPool* commandPool, uint32_t frame, ValiumThreadPool* workers) {
+  VkPipeline pipeline;
+  impl* source = _impl->_GetDrawSource(&pipeline);
+  if (pipeline == VK_NULL_HANDLE || commandPool->GetThreadCount() == 0) {
+    RecordDraw(buffer, framebuffer);
+    return;
+  }
+
+  // Split the regions into one contiguous chunk per recording thread.
+  // A baked viewport is a single draw, so a single chunk.
+  std::vector<VkRect2D> regions = _impl->_GetRegions(source->_dynamicViewport);
+  uint32_t chunkCount = std::max<uint32_t>(1, std::min<uint32_t>(commandPool->GetThreadCount(), static_cast<uint32_t>(regions.size())));
+  if (chunkCount == 1) {
+    // One chunk would only add a thread handoff and a secondary buffer
+    RecordDraw(buffer, framebuffer);
+    return;
+  }
+  std::vector<VkCommandBuffer> secondaries(chunkCount, VK_NULL_HANDLE);
+  std::vector<std::exception_ptr> errors(chunkCount);
+
+  VkCommandBufferInheritanceInfo inheritance{};
+  inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance.renderPass = _impl->_renderPass->GetVkRenderPass();
+  inheritance.subpass = 0;
+  inheritance.framebuffer = framebuffer;
+
+  for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+    size_t first = regions.size() * chunk / chunkCount;
+    size_t last = regions.size() * (chunk + 1) / chunkCount;
+    std::vector<VkRect2D> chunkRegions(regions.begin() + first, regions.begin() + last);
+
+    // Each chunk has its own pool, so the workers never share one
+    workers->Submit([=, &secondaries, &errors, &inheritance]() {
+      try {
+        VkCommandBuffer secondary = commandPool->BeginSecondary(frame, chunk, inheritance);
+        source->_RecordRegions(secondary, pipeline, chunkRegions);
+        if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+          throw std::runtime_error("failed to record secondary command buffer!");
+        }
+        secondaries[chunk] = secondary;
+      } catch (...) {
+        errors[chunk] = std::current_exception();
+      }
+    });
+  }
+  workers->WaitIdle();
+
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // Secondaries only record inside the renderpass, the culling pass goes in the primary
+  if (source->_indirect != nullptr) {
+    source->_indirect->RecordCull(buffer);
+  }
+  _impl->_BeginRenderPass(buffer, framebuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  vkCmdExecuteCommands(buffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+  vkCmdEndRenderPass(buffer);
 }
@@ -1,9 +1,19 @@
 #pragma once
 
 #include "valium_renderpass.h"
-#include "valium_swapchain.h"
+#include "valium_pipeline_registry.h"
+#include "valium_shader_cache.h"
+#include "valium_layout_cache.h"
+#include "valium_buffer.h"
+#include "valium_command_pool.h"
+#include "valium_thread_pool.h"
+#include "valium_bindless.h"
+#include "valium_indirect.h"
+#include "valium_uniform_ring.h"
+#include "valium_descriptor_allocator.h"
 #include <vulkan/vulkan.h>
 #include <string>
+#include <vector>
 
 /**
  * Manages the graphics pipeline
@@ -15,28 +25,284 @@ class ValiumGraphics
    * Initializes a graphics pipeline
    *
    * @param[in] device Device to create the graphics pipeline on.
-   * @param[in] swapchain The swapchain that will be used in the graphics pipeline
+   * @param[in] extent Extent of the images that will be rendered to
+   * @param[in] finalLayout Layout rendered images are left in, see ValiumRenderPass
+   * @param[in] cache Pipeline cache shared by the device's pipelines, may be VK_NULL_HANDLE
+   * @param[in] shaderCache Shader modules shared by the device's pipelines.
+   *                        nullptr gives this pipeline a cache of its own.
+   * @param[in] layoutCache Layouts shared by the device's pipelines.
+   *                        nullptr gives this pipeline a cache of its own.
    */
-  ValiumGraphics(VkDevice device, ValiumSwapchain* swapchain);
+  ValiumGraphics(VkDevice device, VkExtent2D extent, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VkPipelineCache cache = VK_NULL_HANDLE, ValiumShaderCache* shaderCache = nullptr, ValiumLayoutCache* layoutCache = nullptr);
   ~ValiumGraphics();
 
   /**
-   * Load a compiled shader
+   * Load a compiled shader. The file is mapped rather than read, and a file
+   * already loaded through the same shader cache reuses its module.
    *
    * @param[in] shader Path to the compiled shader
    */
   void LoadShader(const std::string& shader, VkShaderStageFlagBits type);
 
   /**
-   * Create the graphics pipeline, do this after loading shaders
+   * Load a shader from SPIR-V already in memory, e.g. one embedded in the
+   * binary. Identical SPIR-V loaded through the same shader cache reuses
+   * its module.
+   *
+   * @param[in] code SPIR-V words, only read during the call
+   * @param[in] size Size of @a code in bytes
+   */
+  void LoadShader(const uint32_t* code, size_t size, VkShaderStageFlagBits type);
+
+  /**
+   * Load a shader from an array of SPIR-V words, see valium_embedded_shaders.h
+   */
+  template <size_t N>
+  void LoadShader(const uint32_t (&code)[N], VkShaderStageFlagBits type) {
+    LoadShader(code, N * sizeof(uint32_t), type);
+  }
+
+  /**
+   * Create the graphics pipeline, do this after loading shaders.
+   * The pipeline layout and vertex input state are reflected from the shaders.
    */
   void InitializePipeline();
 
+  /**
+   * Requests the graphics pipeline from @a registry instead of compiling it
+   * on the calling thread, do this after loading shaders. A pipeline with
+   * identical state is shared, otherwise it is compiled in the background.
+   * Until it is ready RecordDraw() draws with the fallback pipeline, or only clears.
+   *
+   * @param[in] registry Registry to request the pipeline from
+   */
+  void InitializePipelineAsync(ValiumPipelineRegistry* registry);
+
+  /**
+   * @returns true once this pipeline can be drawn with
+   */
+  bool IsPipelineReady();
+
+  /**
+   * Describes this pipeline, e.g. to submit variants of it to a
+   * ValiumPipelineCompiler in one batch
+   */
+  ValiumPipelineDesc GetPipelineDesc();
+
+  /**
+   * Sets the rasterization, multisample and blend state
+   *
+   * @note Must be called before InitializePipeline()
+   */
+  void SetFixedFunctionState(const ValiumFixedFunctionState& state);
+
+  /**
+   * Sets the specialization constants of every shader in @a stage, e.g.
+   * light counts or feature toggles the driver can constant fold. Build
+   * float values with ValiumSpecFloat().
+   *
+   * Before the pipeline is initialized this just sets the constants. After
+   * InitializePipelineAsync() it switches to that variant. Variants are
+   * registered by hash, so each distinct set is compiled once and switching
+   * back to it is free. Constants that size descriptor or uniform block
+   * arrays resize the pipeline layout to match.
+   *
+   * @param[in] stage Stage whose shaders get the constants
+   * @param[in] constants Values keyed by constant_id, replacing any set before
+   */
+  void SetSpecialization(VkShaderStageFlagBits stage, const ValiumSpecialization& constants);
+
+  /**
+   * @returns the hash of the current pipeline's description. Equal IDs
+   * mean interchangeable pipelines, so draws can be sorted by it to
+   * minimize pipeline binds.
+   */
+  uint64_t GetPipelineId();
+
+  /**
+   * Sets a pipeline to draw with while this one is still compiling.
+   * It must use a compatible renderpass.
+   *
+   * @param[in] fallback Pipeline to substitute, nullptr to skip the draw instead
+   */
+  void SetFallback(ValiumGraphics* fallback);
+
+  /**
+   * Returns the layout reflected from the shaders, for binding descriptor
+   * sets and push constants. VK_NULL_HANDLE before the pipeline is initialized.
+   */
+  VkPipelineLayout GetPipelineLayout();
+
   /**
    * Returns the generated renderpass for this pipeline
    */
   ValiumRenderPass* GetRenderPass();
 
+  /**
+   * Chooses between dynamic viewport and scissor state (the default) and
+   * baking them into the pipeline. Dynamic state lets one pipeline render
+   * at any extent. Baked state needs a new pipeline on every extent change.
+   *
+   * @note Must be called before InitializePipeline()
+   */
+  void SetDynamicViewport(bool enabled);
+
+  /**
+   * Sets the regions of the framebuffer RecordDraw() draws into, e.g. one per
+   * player for split-screen. Each region gets its own viewport and scissor
+   * set while recording, so changing them never rebuilds the pipeline.
+   * An empty list draws to the whole framebuffer.
+   *
+   * @note Only used with dynamic viewport state, see SetDynamicViewport()
+   */
+  void SetViewportRegions(const std::vector<VkRect2D>& regions);
+
+  /**
+   * Draws vertices from @a buffer, bound to binding 0, instead of the ones
+   * hardcoded in the shader. The layout of each vertex is reflected from
+   * the vertex shader's inputs. nullptr goes back to the hardcoded triangle.
+   *
+   * @param[in] buffer Vertex buffer, must outlive any frame recorded with it
+   * @param[in] vertexCount Number of vertices to draw when no index buffer is set
+   */
+  void SetVertexBuffer(ValiumBuffer* buffer, uint32_t vertexCount);
+
+  /**
+   * Draws with vkCmdDrawIndexed() using the indices in @a buffer.
+   * nullptr draws the vertex buffer in order instead.
+   *
+   * @param[in] buffer Index buffer, must outlive any frame recorded with it
+   * @param[in] indexCount Number of indices to draw
+   * @param[in] indexType Type of each index
+   */
+  void SetIndexBuffer(ValiumBuffer* buffer, uint32_t indexCount, VkIndexType indexType = VK_INDEX_TYPE_UINT16);
+
+  /**
+   * Draws the records of @a draws instead of the whole index or vertex
+   * buffer. RecordDraw() culls them in a compute pass ahead of the
+   * renderpass, then draws the survivors indirectly with this pipeline's
+   * geometry bound. nullptr goes back to direct draws.
+   *
+   * @param[in] draws Scene to draw, must outlive any frame recorded with it
+   */
+  void SetIndirectDraws(ValiumIndirectDraws* draws);
+
+  /**
+   * Sets the push constant data recorded before every draw, the cheapest
+   * way to pass small per draw values such as a transform or material ID.
+   * Byte offsets match the shaders' push constant block, and ranges the
+   * data doesn't cover are pushed as zero. The ranges themselves are
+   * reflected from the shaders.
+   *
+   * Static command buffers keep the data they were recorded with, call
+   * ValiumDevice::MarkSceneDirty() after changing it.
+   *
+   * @param[in] data Bytes of the push constant block, copied
+   * @param[in] size Number of bytes in @a data
+   */
+  void SetPushConstants(const void* data, uint32_t size);
+
+  /**
+   * Places @a table's set at set number @a set of the pipeline layout, in
+   * place of whatever the shaders declare there, and binds it before every
+   * draw. Shaders index its arrays with runtime sized arrays at that set.
+   *
+   * @param[in] table Table to bind, nullptr to use the reflected set again
+   * @param[in] set Set number the table is bound at
+   * @note Must be called before InitializePipeline()
+   */
+  void SetBindlessTable(ValiumBindlessTable* table, uint32_t set);
+
+  /**
+   * Feeds the shaders' uniform blocks from @a ring. Every descriptor set
+   * made only of uniform blocks gets VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+   * bindings, and each recorded draw copies the data of SetUniformData()
+   * into the ring and binds a set from @a descriptors with the copies'
+   * dynamic offsets. Sets mixing in other descriptor types are left unbound.
+   *
+   * Slices and sets only live for the frame they were recorded in, so
+   * don't use this with command buffers that are submitted again.
+   *
+   * @param[in] ring Ring the uniform data is copied into, nullptr to stop using one
+   * @param[in] descriptors Allocator for the per frame sets
+   * @note Must be called before InitializePipeline()
+   */
+  void SetUniformRing(ValiumUniformRing* ring, ValiumDescriptorAllocator* descriptors);
+
+  /**
+   * Sets the data of one uniform block, copied into the uniform ring by
+   * every recorded draw. Bytes the data doesn't cover are zero, like
+   * SetPushConstants().
+   *
+   * @param[in] set Descriptor set of the block
+   * @param[in] binding Binding of the block
+   * @param[in] data Bytes of the block, copied
+   * @param[in] size Number of bytes in @a data
+   */
+  void SetUniformData(uint32_t set, uint32_t binding, const void* data, uint32_t size);
+
+  /**
+   * Updates the extent of the images being rendered to. With dynamic
+   * viewport state the pipeline is kept and only the render area, viewport
+   * and scissor recorded by RecordDraw() change. Baked viewports force the
+   * pipeline to be rebuilt.
+   *
+   * @param[in] extent New extent, e.g. after the swapchain was recreated
+   */
+  void SetExtent(VkExtent2D extent);
+
+  /**
+   * Watches the files passed to LoadShader() and rebuilds the pipeline on
+   * the registry's compiler whenever one of them changes. Shaders
+   * loaded from memory are never reloaded.
+   *
+   * @param[in] framesInFlight Frames that may still use a replaced pipeline
+   * @note Call after InitializePipelineAsync()
+   */
+  void EnableHotReload(uint32_t framesInFlight);
+
+  /**
+   * Swaps in a pipeline rebuilt by a hot reload if it has finished
+   * compiling. Call once per frame at a frame boundary, before recording.
+   * Never waits on a compile.
+   *
+   * @returns true if a new pipeline was swapped in
+   */
+  bool ApplyReload();
+
+  /**
+   * Records the renderpass and a draw with this pipeline into @a buffer.
+   * If the pipeline is still compiling the fallback is drawn with instead,
+   * and without a ready fallback the renderpass only clears.
+   *
+   * @param[in] buffer Command buffer that is currently recording
+   * @param[in] framebuffer Framebuffer to render into
+   */
+  void RecordDraw(VkCommandBuffer buffer, VkFramebuffer framebuffer);
+
+  /**
+   * @returns the pipeline RecordDraw() would bind right now, the fallback's
+   *          if this one isn't ready, VK_NULL_HANDLE if neither is. A change
+   *          means recorded command buffers are out of date.
+   */
+  VkPipeline GetDrawPipeline();
+
+  /**
+   * Same as RecordDraw(), but the draws are recorded into secondary command
+   * buffers on @a workers and executed from @a buffer. The viewport regions
+   * are split into one chunk per recording thread of @a commandPool, so
+   * only several regions are recorded in parallel. Falls back to
+   * RecordDraw() if the pool has no recording threads or there is only
+   * one chunk to record.
+   *
+   * @param[in] buffer Primary command buffer that is currently recording
+   * @param[in] framebuffer Framebuffer to render into
+   * @param[in] commandPool Pool the secondary buffers come from
+   * @param[in] frame Frame in flight being recorded
+   * @param[in] workers Threads to record on
+   */
+  void RecordDrawParallel(VkCommandBuffer buffer, VkFramebuffer framebuffer, ValiumCommandPool* commandPool, uint32_t frame, ValiumThreadPool* workers);
+
  private:
   struct impl;
   impl* _impl;
@@ -0,0 +1,307 @@
+#include "valium_indirect.h"
+#include "valium_embedded_shaders.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/** Invocations per workgroup of shaders/cull.comp */
+#define CULL_GROUP_SIZE 64
+
+/**
+ * Push constant block of shaders/cull.comp
+ */
+struct CullConstants {
+  /** Frustum planes with inward normals, xyz normal and w distance */
+  float planes[6][4];
+
+  /** Number of records to test */
+  uint32_t recordCount;
+
+  /** Non-zero packs visible draws to the front and counts them */
+  uint32_t compact;
+};
+
+struct ValiumIndirectDraws::impl {
+  /** Device the pipeline and buffers are created on */
+  VkDevice _device;
+
+  /** Allocator for the buffers */
+  ValiumAllocator* _allocator;
+
+  /** Copies the records into @a _records */
+  ValiumUploader* _uploader;
+
+  /** Layout of the culling pipeline, owned by the layout cache */
+  VkPipelineLayout _layout = VK_NULL_HANDLE;
+
+  /** Culling pipeline */
+  VkPipeline _pipeline = VK_NULL_HANDLE;
+
+  /** Pool holding only @a _set */
+  VkDescriptorPool _pool = VK_NULL_HANDLE;
+
+  /** Points the culling shader at the three buffers */
+  VkDescriptorSet _set = VK_NULL_HANDLE;
+
+  /** Draw records of the scene */
+  ValiumBuffer* _records = nullptr;
+
+  /** Indirect commands written by the culling pass, one slot per record */
+  ValiumBuffer* _commands = nullptr;
+
+  /** Records @a _records and @a _commands have room for */
+  uint32_t _capacity = 0;
+
+  /** Number of commands written when compacting */
+  ValiumBuffer* _count = nullptr;
+
+  /** Pushed to the culling pass */
+  CullConstants _constants{};
+
+  /** vkCmdDrawIndexedIndirectCountKHR, nullptr without VK_KHR_draw_indirect_count */
+  PFN_vkCmdDrawIndexedIndirectCountKHR _drawIndexedIndirectCount = nullptr;
+
+  /** Most commands one indirect draw may consume, 1 without multiDrawIndirect */
+  uint32_t _maxDrawIndirectCount = 1;
+
+  /**
+   * Destroys whatever was created so far
+   */
+  void _Destroy();
+
+  /**
+   * Points @a _set at the current buffers
+   */
+  void _WriteDescriptors();
+};
+
+void ValiumIndirectDraws::impl::_Destroy() {
+  delete _records;
+  delete _commands;
+  delete _count;
+  if (_pool != VK_NULL_HANDLE) {
+    vkDestroyDescriptorPool(_device, _pool, nullptr);
+  }
+  if (_pipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+  }
+}
+
+ValiumIndirectDraws::ValiumIndirectDraws(VkPhysicalDevice physicalDevice, VkDevice device, ValiumAllocator* allocator, ValiumUploader* uploader, ValiumShaderCache* shaderCache, ValiumLayoutCache* layoutCache, VkPipelineCache cache, bool drawIndirectCount, bool multiDrawIndirect) {
+  _impl = new impl();
+  _impl->_device = device;
+  _impl->_allocator = allocator;
+  _impl->_uploader = uploader;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  _impl->_maxDrawIndirectCount = multiDrawIndirect ? properties.limits.maxDrawIndirectCount : 1;
+
+  if (drawIndirectCount) {
+    _impl->_drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+        vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+  }
+
+  // Cull against normalized device coordinates until a camera is set
+  const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+  SetViewProjection(identity);
+
+  try {
+    // The layout comes from the shader like every graphics pipeline's
+    VkShaderModule module = shaderCache->GetModule(ValiumEmbeddedShaders::CULL_COMP, sizeof(ValiumEmbeddedShaders::CULL_COMP));
+    const ShaderReflection& reflection = shaderCache->GetReflection(module);
+    VkDescriptorSetLayout setLayout = layoutCache->GetSetLayout(reflection.sets.at(0));
+    _impl->_layout = layoutCache->GetPipelineLayout({setLayout}, reflection.pushConstants);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _impl->_layout;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+    std::cout << "Creating the culling pipeline" << std::endl;
+#endif
+    if (vkCreateComputePipelines(device, cache, 1, &pipelineInfo, nullptr, &_impl->_pipeline) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling pipeline!");
+    }
+
+    VkDescriptorPoolSize size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3};
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &size;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &_impl->_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _impl->_pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    if (vkAllocateDescriptorSets(device, &allocInfo, &_impl->_set) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate culling descriptor set!");
+    }
+
+    _impl->_count = new ValiumBuffer(allocator, device, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+
+    // An empty scene still needs valid descriptors
+    SetDraws({});
+  } catch (...) {
+    _impl->_Destroy();
+    delete _impl;
+    throw;
+  }
+}
+
+ValiumIndirectDraws::~ValiumIndirectDraws() {
+  _impl->_Destroy();
+  delete _impl;
+}
+
+void ValiumIndirectDraws::impl::_WriteDescriptors() {
+  VkDescriptorBufferInfo buffers[3] = {
+    {_records->GetVkBuffer(), 0, VK_WHOLE_SIZE},
+    {_commands->GetVkBuffer(), 0, VK_WHOLE_SIZE},
+    {_count->GetVkBuffer(), 0, VK_WHOLE_SIZE}
+  };
+
+  VkWriteDescriptorSet writes[3]{};
+  for (uint32_t i = 0; i < 3; i++) {
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = _set;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo = &buffers[i];
+  }
+  vkUpdateDescriptorSets(_device, 3, writes, 0, nullptr);
+}
+
+void ValiumIndirectDraws::SetDraws(const std::vector<ValiumDrawRecord>& records) {
+  uint32_t count = static_cast<uint32_t>(records.size());
+  // Buffers can't be empty, an empty scene keeps one unused slot
+  VkDeviceSize slots = std::max<uint32_t>(1, count);
+
+  if (slots > _impl->_capacity) {
+    // Uploads into the old records may still be queued, the uploader
+    // destroys them once they and the current frame are done
+    if (_impl->_records != nullptr) {
+      _impl->_uploader->Retire(_impl->_records);
+      _impl->_records = nullptr;
+    }
+    if (_impl->_commands != nullptr) {
+      _impl->_uploader->Retire(_impl->_commands);
+      _impl->_commands = nullptr;
+    }
+    _impl->_records = new ValiumBuffer(_impl->_allocator, _impl->_device, slots * sizeof(ValiumDrawRecord), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    _impl->_commands = new ValiumBuffer(_impl->_allocator, _impl->_device, slots * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    _impl->_capacity = static_cast<uint32_t>(slots);
+    _impl->_WriteDescriptors();
+  }
+  // Ordered after earlier frames' reads of the records by the uploader
+  if (count > 0) {
+    _impl->_uploader->Upload(_impl->_records, records.data(), count * sizeof(ValiumDrawRecord));
+  }
+
+  _impl->_constants.recordCount = count;
+  // The count variant still caps each draw call at maxDrawIndirectCount
+  _impl->_constants.compact = _impl->_drawIndexedIndirectCount != nullptr && count <= _impl->_maxDrawIndirectCount;
+}
+
+void ValiumIndirectDraws::SetViewProjection(const float (&viewProjection)[16]) {
+  // Gribb and Hartmann plane extraction from the rows of the matrix, with
+  // Vulkan's 0 to w depth range for the near plane
+  float rows[4][4];
+  for (int row = 0; row < 4; row++) {
+    for (int column = 0; column < 4; column++) {
+      rows[row][column] = viewProjection[column * 4 + row];
+    }
+  }
+
+  for (int component = 0; component < 4; component++) {
+    float w = rows[3][component];
+    _impl->_constants.planes[0][component] = w + rows[0][component];
+    _impl->_constants.planes[1][component] = w - rows[0][component];
+    _impl->_constants.planes[2][component] = w + rows[1][component];
+    _impl->_constants.planes[3][component] = w - rows[1][component];
+    _impl->_constants.planes[4][component] = rows[2][component];
+    _impl->_constants.planes[5][component] = w - rows[2][component];
+  }
+
+  // Unit normals make the plane distance comparable to the sphere radius
+  for (auto& plane : _impl->_constants.planes) {
+    float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    if (length > 0.0f) {
+      for (float& component : plane) {
+        component /= length;
+      }
+    }
+  }
+}
+
+void ValiumIndirectDraws::RecordCull(VkCommandBuffer buffer) {
+  if (_impl->_constants.recordCount == 0) {
+    return;
+  }
+
+  // The previous frame's draws read the commands this pass overwrites
+  vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+  if (_impl->_constants.compact) {
+    vkCmdFillBuffer(buffer, _impl->_count->GetVkBuffer(), 0, sizeof(uint32_t), 0);
+
+    VkMemoryBarrier cleared{};
+    cleared.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cleared.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    cleared.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &cleared, 0, nullptr, 0, nullptr);
+  }
+
+  vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _impl->_pipeline);
+  vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _impl->_layout, 0, 1, &_impl->_set, 0, nullptr);
+  vkCmdPushConstants(buffer, _impl->_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &_impl->_constants);
+  vkCmdDispatch(buffer, (_impl->_constants.recordCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  VkMemoryBarrier culled{};
+  culled.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  culled.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  culled.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                       0, 1, &culled, 0, nullptr, 0, nullptr);
+}
+
+void ValiumIndirectDraws::RecordDraws(VkCommandBuffer buffer) {
+  uint32_t count = _impl->_constants.recordCount;
+  if (count == 0) {
+    return;
+  }
+
+  VkBuffer commands = _impl->_commands->GetVkBuffer();
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  if (_impl->_constants.compact) {
+    // Only the survivors are read, the GPU supplies how many there are
+    _impl->_drawIndexedIndirectCount(buffer, commands, 0, _impl->_count->GetVkBuffer(), 0, count, stride);
+    return;
+  }
+
+  // Every slot is drawn, culled ones have no instances
+  for (uint32_t first = 0; first < count; first += _impl->_maxDrawIndirectCount) {
+    uint32_t batch = std::min(count - first, _impl->_maxDrawIndirectCount);
+    vkCmdDrawIndexedIndirect(buffer, commands, first * stride, batch, stride);
+  }
+}
+
+uint32_t ValiumIndirectDraws::GetDrawCount() const {
+  return _impl->_constants.recordCount;
+}
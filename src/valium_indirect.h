@@ -0,0 +1,118 @@
+#pragma once
+
+#include "valium_buffer.h"
+#include "valium_uploader.h"
+#include "valium_shader_cache.h"
+#include "valium_layout_cache.h"
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+/**
+ * One object of a GPU driven scene, laid out to match shaders/cull.comp
+ */
+struct ValiumDrawRecord {
+  /** Center of the object's bounding sphere */
+  float center[3] = {0.0f, 0.0f, 0.0f};
+
+  /** Radius of the object's bounding sphere */
+  float radius = 0.0f;
+
+  /** Indices drawn for the object */
+  uint32_t indexCount = 0;
+
+  /** First index of the object in the index buffer */
+  uint32_t firstIndex = 0;
+
+  /** Added to each index before reading the vertex buffer */
+  int32_t vertexOffset = 0;
+
+  /** Keeps records 16 byte aligned */
+  uint32_t padding = 0;
+};
+
+/**
+ * Draws a whole scene with one indirect draw per frame.
+ *
+ * The scene's draw records live in a device local storage buffer. Each
+ * frame RecordCull() dispatches shaders/cull.comp, which tests every
+ * record's bounding sphere against the view frustum and writes a
+ * VkDrawIndexedIndirectCommand per visible record. RecordDraws() then
+ * issues them all with vkCmdDrawIndexedIndirectCount when the device has
+ * VK_KHR_draw_indirect_count, so culled objects cost nothing. Otherwise
+ * every record keeps its slot, culled ones with no instances, and the slots
+ * are drawn with vkCmdDrawIndexedIndirect.
+ *
+ * The commands are written on the graphics queue ahead of the renderpass,
+ * so one set of buffers serves every frame in flight.
+ */
+class ValiumIndirectDraws
+{
+ public:
+  /**
+   * Creates the culling pipeline
+   *
+   * @param[in] physicalDevice Device to read the indirect draw limits from
+   * @param[in] device Device to create the pipeline and buffers on
+   * @param[in] allocator Allocator for the record and command buffers
+   * @param[in] uploader Uploader the records are copied in with
+   * @param[in] shaderCache Cache the culling shader is loaded through
+   * @param[in] layoutCache Cache the culling pipeline's layout comes from
+   * @param[in] cache Pipeline cache to compile with, may be VK_NULL_HANDLE
+   * @param[in] drawIndirectCount True if VK_KHR_draw_indirect_count is enabled
+   * @param[in] multiDrawIndirect True if the multiDrawIndirect feature is enabled
+   */
+  ValiumIndirectDraws(VkPhysicalDevice physicalDevice, VkDevice device, ValiumAllocator* allocator, ValiumUploader* uploader, ValiumShaderCache* shaderCache, ValiumLayoutCache* layoutCache, VkPipelineCache cache, bool drawIndirectCount, bool multiDrawIndirect);
+  ~ValiumIndirectDraws();
+
+  /**
+   * Replaces the scene's draw records. They are uploaded with the next
+   * frame, into the current buffers if they fit.
+   *
+   * Static command buffers keep the record count and draw mode they were
+   * recorded with, call ValiumDevice::MarkSceneDirty() after changing them.
+   *
+   * @note More records than ever set before need new buffers and rewrite
+   *       the culling pass's descriptor set, so frames using the previous
+   *       records must have completed, e.g. call before the first frame or
+   *       after ValiumDevice::WaitIdle()
+   */
+  void SetDraws(const std::vector<ValiumDrawRecord>& records);
+
+  /**
+   * Sets the matrix the frustum planes are taken from. Records are in the
+   * space the matrix transforms to clip space, the identity culls against
+   * normalized device coordinates, which is the default.
+   *
+   * Static command buffers keep the planes they were recorded with, call
+   * ValiumDevice::MarkSceneDirty() after changing it.
+   *
+   * @param[in] viewProjection Column major 4x4 matrix
+   */
+  void SetViewProjection(const float (&viewProjection)[16]);
+
+  /**
+   * Records the culling pass. Must be outside a renderpass.
+   *
+   * @param[in] buffer Graphics command buffer that is currently recording
+   */
+  void RecordCull(VkCommandBuffer buffer);
+
+  /**
+   * Records the draws written by the last RecordCull(). The graphics
+   * pipeline and the index and vertex buffers the records refer to must
+   * already be bound.
+   *
+   * @param[in] buffer Command buffer recording inside the renderpass
+   */
+  void RecordDraws(VkCommandBuffer buffer);
+
+  /**
+   * @returns the number of records in the scene
+   */
+  uint32_t GetDrawCount() const;
+
+ private:
+  struct impl;
+  impl* _impl;
+};
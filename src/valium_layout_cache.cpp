@@ -0,0 +1,189 @@
+#include "valium_layout_cache.h"
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <tuple>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/**
+ * Comparable form of a set layout. Immutable samplers aren't supported.
+ */
+typedef std::vector<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>> SetLayoutKey;
+
+/**
+ * Comparable form of a pipeline layout
+ */
+typedef std::pair<std::vector<VkDescriptorSetLayout>, std::vector<std::tuple<uint32_t, uint32_t, uint32_t>>> PipelineLayoutKey;
+
+/**
+ * Folds @a value into an FNV-1a hash one byte at a time
+ */
+static void HashValue(uint64_t& hash, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    hash ^= (value >> (i * 8)) & 0xff;
+    hash *= 1099511628211ull;
+  }
+}
+
+struct ValiumLayoutCache::impl {
+  /** Device the layouts are created on */
+  VkDevice _device;
+
+  /** Guards both maps */
+  std::mutex _mutex;
+
+  /** Set layouts keyed by their bindings */
+  std::map<SetLayoutKey, VkDescriptorSetLayout> _setLayouts;
+
+  /** Pipeline layouts keyed by their sets and push constants */
+  std::map<PipelineLayoutKey, VkPipelineLayout> _pipelineLayouts;
+
+  /** Hash of each set layout's bindings */
+  std::unordered_map<VkDescriptorSetLayout, uint64_t> _setLayoutHashes;
+
+  /** Descriptors of each type in each set layout, see GetDescriptorCounts() */
+  std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorPoolSize>> _setLayoutCounts;
+
+  /** Hash of each pipeline layout's sets and push constants, see GetKey() */
+  std::unordered_map<VkPipelineLayout, uint64_t> _pipelineLayoutHashes;
+};
+
+ValiumLayoutCache::ValiumLayoutCache(VkDevice device) {
+  _impl = new impl();
+  _impl->_device = device;
+}
+
+ValiumLayoutCache::~ValiumLayoutCache() {
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying " << _impl->_pipelineLayouts.size() << " pipeline layouts and "
+            << _impl->_setLayouts.size() << " descriptor set layouts" << std::endl;
+#endif
+  for (auto& entry : _impl->_pipelineLayouts) {
+    vkDestroyPipelineLayout(_impl->_device, entry.second, nullptr);
+  }
+  for (auto& entry : _impl->_setLayouts) {
+    vkDestroyDescriptorSetLayout(_impl->_device, entry.second, nullptr);
+  }
+  delete _impl;
+}
+
+VkDescriptorSetLayout ValiumLayoutCache::GetSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+  SetLayoutKey key;
+  for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+    if (binding.pImmutableSamplers != nullptr) {
+      throw std::runtime_error("immutable samplers can't be cached!");
+    }
+    key.emplace_back(binding.binding, binding.descriptorType, binding.descriptorCount, binding.stageFlags);
+  }
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto existing = _impl->_setLayouts.find(key);
+  if (existing != _impl->_setLayouts.end()) {
+    return existing->second;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating descriptor set layout" << std::endl;
+#endif
+  VkDescriptorSetLayout layout;
+  if (vkCreateDescriptorSetLayout(_impl->_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor set layout!");
+  }
+
+  uint64_t hash = 14695981039346656037ull;
+  for (const auto& binding : key) {
+    HashValue(hash, std::get<0>(binding));
+    HashValue(hash, std::get<1>(binding));
+    HashValue(hash, std::get<2>(binding));
+    HashValue(hash, std::get<3>(binding));
+  }
+
+  std::map<VkDescriptorType, uint32_t> counts;
+  for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+    counts[binding.descriptorType] += binding.descriptorCount;
+  }
+  std::vector<VkDescriptorPoolSize>& sizes = _impl->_setLayoutCounts[layout];
+  for (const auto& count : counts) {
+    sizes.push_back({count.first, count.second});
+  }
+
+  _impl->_setLayouts[key] = layout;
+  _impl->_setLayoutHashes[layout] = hash;
+  return layout;
+}
+
+VkPipelineLayout ValiumLayoutCache::GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstants) {
+  PipelineLayoutKey key;
+  key.first = setLayouts;
+  for (const VkPushConstantRange& range : pushConstants) {
+    key.second.emplace_back(range.stageFlags, range.offset, range.size);
+  }
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto existing = _impl->_pipelineLayouts.find(key);
+  if (existing != _impl->_pipelineLayouts.end()) {
+    return existing->second;
+  }
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+  pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+  pipelineLayoutInfo.pPushConstantRanges = pushConstants.data();
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating pipeline layout" << std::endl;
+#endif
+  VkPipelineLayout layout;
+  if (vkCreatePipelineLayout(_impl->_device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline layout!");
+  }
+
+  uint64_t hash = 14695981039346656037ull;
+  HashValue(hash, setLayouts.size());
+  for (VkDescriptorSetLayout setLayout : setLayouts) {
+    auto setHash = _impl->_setLayoutHashes.find(setLayout);
+    HashValue(hash, setHash != _impl->_setLayoutHashes.end() ? setHash->second : (uint64_t) setLayout);
+  }
+  for (const auto& range : key.second) {
+    HashValue(hash, std::get<0>(range));
+    HashValue(hash, std::get<1>(range));
+    HashValue(hash, std::get<2>(range));
+  }
+
+  _impl->_pipelineLayouts[key] = layout;
+  _impl->_pipelineLayoutHashes[layout] = hash;
+  return layout;
+}
+
+uint64_t ValiumLayoutCache::GetKey(VkPipelineLayout layout) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto hash = _impl->_pipelineLayoutHashes.find(layout);
+  if (hash == _impl->_pipelineLayoutHashes.end()) {
+    throw std::runtime_error("pipeline layout is not from this cache!");
+  }
+  return hash->second;
+}
+
+std::vector<VkDescriptorPoolSize> ValiumLayoutCache::GetDescriptorCounts(VkDescriptorSetLayout layout) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto counts = _impl->_setLayoutCounts.find(layout);
+  if (counts == _impl->_setLayoutCounts.end()) {
+    throw std::runtime_error("descriptor set layout is not from this cache!");
+  }
+  return counts->second;
+}
+
+size_t ValiumLayoutCache::GetSetLayoutCount() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  return _impl->_setLayouts.size();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Device wide cache of descriptor set layouts and pipeline layouts.
+ *
+ * Identical layouts are created once and shared, so pipelines built from
+ * shaders with the same interface end up with the same VkPipelineLayout
+ * and descriptor sets bound for one stay bound for the other. The cache
+ * owns every layout it returns. Safe to use from several threads.
+ */
+class ValiumLayoutCache
+{
+ public:
+  /**
+   * @param[in] device Device to create layouts on
+   */
+  ValiumLayoutCache(VkDevice device);
+
+  /**
+   * Destroys every cached layout
+   */
+  ~ValiumLayoutCache();
+
+  /**
+   * Returns the set layout for @a bindings, creating it on first use
+   *
+   * @param[in] bindings Bindings of the set, sorted by binding number
+   */
+  VkDescriptorSetLayout GetSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+  /**
+   * Returns the pipeline layout for the given sets and push constants,
+   * creating it on first use
+   *
+   * @param[in] setLayouts Set layouts from GetSetLayout(), indexed by set number
+   * @param[in] pushConstants Push constant ranges
+   */
+  VkPipelineLayout GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstants);
+
+  /**
+   * Returns a hash of the layout's bindings and push constants. It is the
+   * same in every run, unlike the handle. Set layouts that didn't come from
+   * GetSetLayout() are hashed by handle.
+   *
+   * @param[in] layout A layout returned by GetPipelineLayout()
+   */
+  uint64_t GetKey(VkPipelineLayout layout);
+
+  /**
+   * Returns the number of descriptors of each type in a set layout, what
+   * a descriptor pool needs to hold one set of it
+   *
+   * @param[in] layout A layout returned by GetSetLayout()
+   */
+  std::vector<VkDescriptorPoolSize> GetDescriptorCounts(VkDescriptorSetLayout layout);
+
+  /**
+   * @returns the number of distinct set layouts created
+   */
+  size_t GetSetLayoutCount();
+
+ private:
+  struct impl;
+  impl* _impl;
+};
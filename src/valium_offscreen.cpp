@@ -0,0 +1,146 @@
+#include "valium_offscreen.h"
+#include "valium_view.h"
+#include "app_config.h"
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+struct ValiumOffscreen::impl {
+  /** Allocator the image memory comes from */
+  ValiumAllocator* const _allocator;
+
+  /** Logical device that owns the images */
+  const VkDevice _device;
+
+  /** Size of every image */
+  VkExtent2D _extent;
+
+  /** Images rendered to in place of swapchain images */
+  std::vector<VkImage> _images;
+
+  /** Memory backing each image in @a _images */
+  std::vector<ValiumAllocation> _memory;
+
+  /** Views over each image in @a _images */
+  std::vector<std::unique_ptr<ValiumView>> _views;
+
+  /** The framebuffers used for rendering into the images */
+  std::vector<VkFramebuffer> _frameBuffers;
+
+  impl(ValiumAllocator* allocator, VkDevice device) : _allocator(allocator), _device(device) {}
+
+  /**
+   * Creates a single image, binds memory to it and creates its view
+   */
+  void _CreateImage();
+};
+
+ValiumOffscreen::ValiumOffscreen(ValiumAllocator* allocator, VkDevice device, uint32_t width, uint32_t height, uint32_t count) {
+  _impl = new impl(allocator, device);
+  _impl->_extent = {width, height};
+  for (uint32_t i = 0; i < count; i++) {
+    _impl->_CreateImage();
+  }
+}
+
+ValiumOffscreen::~ValiumOffscreen() {
+  for (auto buf : _impl->_frameBuffers) {
+#ifdef SHOW_RESOURCE_ALLOCATION
+    std::cout << "Destroying framebuffer" << std::endl;
+#endif
+    vkDestroyFramebuffer(_impl->_device, buf, nullptr);
+  }
+
+  // Views must go before the images they look at
+  _impl->_views.clear();
+
+  for (size_t i = 0; i < _impl->_images.size(); i++) {
+#ifdef SHOW_RESOURCE_ALLOCATION
+    std::cout << "Destroying offscreen image" << std::endl;
+#endif
+    vkDestroyImage(_impl->_device, _impl->_images[i], nullptr);
+    _impl->_allocator->Free(_impl->_memory[i]);
+  }
+
+  delete _impl;
+}
+
+void ValiumOffscreen::impl::_CreateImage() {
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = IMAGE_FORMAT;
+  imageInfo.extent.width = _extent.width;
+  imageInfo.extent.height = _extent.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  // Transfer source so rendered frames can be copied out for inspection
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating offscreen image" << std::endl;
+#endif
+  VkImage image;
+  if (vkCreateImage(_device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen image!");
+  }
+
+  ValiumAllocation memory;
+  try {
+    // Render targets are large and live as long as the device, keep them out of the shared blocks
+    memory = _allocator->AllocateForImage(image, ValiumMemoryUsage::GpuOnly, true);
+  } catch (...) {
+    vkDestroyImage(_device, image, nullptr);
+    throw;
+  }
+
+  _images.push_back(image);
+  _memory.push_back(memory);
+  _views.push_back(std::unique_ptr<ValiumView>(new ValiumView(_device, image)));
+}
+
+VkExtent2D ValiumOffscreen::GetExtent() {
+  return _impl->_extent;
+}
+
+uint32_t ValiumOffscreen::GetImageCount() {
+  return static_cast<uint32_t>(_impl->_images.size());
+}
+
+VkFramebuffer ValiumOffscreen::GetFramebuffer(uint32_t index) {
+  return _impl->_frameBuffers.at(index);
+}
+
+void ValiumOffscreen::InitializeFramebuffers(const ValiumRenderPass* renderPass) {
+  _impl->_frameBuffers.resize(_impl->_views.size());
+
+  for (size_t i = 0; i < _impl->_views.size(); i++) {
+    VkImageView attachments[] = {
+      _impl->_views[i]->GetVkImageView()
+    };
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass->GetVkRenderPass();
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = attachments;
+    framebufferInfo.width = _impl->_extent.width;
+    framebufferInfo.height = _impl->_extent.height;
+    framebufferInfo.layers = 1;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+    std::cout << "Creating framebuffer" << std::endl;
+#endif
+    if (vkCreateFramebuffer(_impl->_device, &framebufferInfo, nullptr, &_impl->_frameBuffers[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create framebuffer!");
+    }
+  }
+}
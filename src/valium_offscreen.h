@@ -0,0 +1,53 @@
+#pragma once
+
+#include "valium_renderpass.h"
+#include "valium_allocator.h"
+#include <vulkan/vulkan.h>
+
+/**
+ * Device owned color images that stand in for the swapchain when
+ * Valium is running headless.
+ *
+ * The images are never presented, so rendering into them is limited only
+ * by the device and not by vsync or a compositor.
+ */
+class ValiumOffscreen
+{
+ public:
+  /**
+   * Creates @a count color images along with their memory and views.
+   *
+   * @param[in] allocator Allocator the image memory comes from
+   * @param[in] device Logical device to create the images on
+   * @param[in] width Image width
+   * @param[in] height Image height
+   * @param[in] count Number of images to render to in rotation
+   */
+  ValiumOffscreen(ValiumAllocator* allocator, VkDevice device, uint32_t width, uint32_t height, uint32_t count);
+  ~ValiumOffscreen();
+
+  /**
+   * Initializes the framebuffers for the given renderpass
+   */
+  void InitializeFramebuffers(const ValiumRenderPass* renderPass);
+
+  /**
+   * @returns the extent of the offscreen images
+   */
+  VkExtent2D GetExtent();
+
+  /**
+   * @returns the number of offscreen images
+   */
+  uint32_t GetImageCount();
+
+  /**
+   * @returns the framebuffer for the image at @a index
+   * @note Call after InitializeFramebuffers()
+   */
+  VkFramebuffer GetFramebuffer(uint32_t index);
+
+ private:
+  struct impl;
+  impl* _impl;
+};
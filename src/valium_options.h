@@ -0,0 +1,119 @@
+#pragma once
+
+#include "app_config.h"
+#include <string>
+#include <vector>
+
+/**
+ * Trade off between input latency, frame throughput and power use when
+ * presenting to a window. Each policy falls back to FIFO, which every
+ * device must support, when its preferred present modes aren't available.
+ */
+enum class ValiumPresentPolicy {
+  /**
+   * Prefers MAILBOX, then IMMEDIATE. The newest frame replaces any queued
+   * frame, so input is never more than one frame behind the display.
+   */
+  LowLatency,
+
+  /**
+   * Prefers IMMEDIATE, then MAILBOX. Frames are never throttled by the
+   * display, which may tear.
+   */
+  MaxThroughput,
+
+  /**
+   * FIFO with minImageCount + 1 images. Rendering is held to the display's
+   * refresh rate, which keeps the GPU idle between frames.
+   */
+  PowerSaving
+};
+
+/**
+ * Options that control how Valium is constructed.
+ * The defaults give the normal windowed renderer.
+ */
+struct ValiumOptions {
+  /**
+   * When true no GLFW window or surface is created. Rendering goes to
+   * device owned images instead of a swapchain, so frames are never
+   * throttled by vsync or a compositor.
+   */
+  bool headless = false;
+
+  /** Width of the offscreen images when running headless */
+  uint32_t width = WIDTH;
+
+  /** Height of the offscreen images when running headless */
+  uint32_t height = HEIGHT;
+
+  /**
+   * Number of frames that may be in flight at once. Each frame has its own
+   * command buffer and sync objects so the CPU can record the next frame
+   * while the GPU executes the previous one.
+   */
+  uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT;
+
+  /** How frames are presented to the window. Ignored when running headless */
+  ValiumPresentPolicy presentPolicy = ValiumPresentPolicy::PowerSaving;
+
+  /**
+   * File the pipeline cache is loaded from at startup and saved to at
+   * shutdown. An empty path keeps the cache in memory only.
+   */
+  std::string pipelineCachePath = PIPELINE_CACHE_FILE;
+
+  /**
+   * Number of threads pipelines are compiled on. 0 uses one per hardware thread.
+   */
+  uint32_t pipelineCompileThreads = 0;
+
+  /**
+   * Number of threads that record each frame's draws into secondary command
+   * buffers in parallel. 0 records everything on the render thread.
+   */
+  uint32_t recordThreads = 0;
+
+  /**
+   * Static pass mode for scenes that rarely change. Each image's commands
+   * are recorded once and resubmitted unchanged until
+   * ValiumDevice::MarkSceneDirty() is called, so a static frame costs the
+   * CPU little beyond acquire and present. Ignores recordThreads.
+   */
+  bool staticCommandBuffers = false;
+
+  /**
+   * Priority of each queue created per family, from 0 to 1. Index 0 is used
+   * for frame work. Later entries add queues for other threads, e.g. a low
+   * priority queue for background streaming that yields to rendering.
+   * Families with fewer queues only get the first entries.
+   */
+  std::vector<float> queuePriorities = {1.0f, 0.0f};
+
+  /**
+   * Development mode. Loads the shaders from VERT_SHADER_FILE and
+   * FRAG_SHADER_FILE instead of the copies embedded in the binary, and
+   * rebuilds the pipeline in the background whenever either file changes.
+   */
+  bool hotReloadShaders = false;
+
+  /**
+   * Draws a quad from vertex and index buffers uploaded at startup instead
+   * of the triangle hardcoded in the vertex shader.
+   */
+  bool drawMesh = false;
+
+  /**
+   * Number of quads in a GPU driven scene, 0 to disable it. The quads are
+   * frustum culled by a compute pass each frame and the survivors drawn
+   * with a single indirect draw, see ValiumIndirectDraws. Implies drawMesh.
+   */
+  uint32_t indirectDraws = 0;
+
+  /**
+   * Enables descriptor indexing and binds one large table of sampled
+   * images and storage buffers that shaders index by integer, see
+   * ValiumBindlessTable. Ignored if the device doesn't support it.
+   */
+  bool bindless = false;
+};
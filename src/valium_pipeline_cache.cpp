@@ -0,0 +1,176 @@
+#include "valium_pipeline_cache.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <iostream>
+
+/**
+ * Size of the VK_PIPELINE_CACHE_HEADER_VERSION_ONE header: header size,
+ * header version, vendor ID and device ID followed by the cache UUID.
+ */
+#define PIPELINE_CACHE_HEADER_SIZE (4 * sizeof(uint32_t) + VK_UUID_SIZE)
+
+struct ValiumPipelineCache::impl {
+  /** Device the cache was created for */
+  VkPhysicalDevice _physicalDevice;
+
+  /** Logical device that owns the cache */
+  VkDevice _device;
+
+  /** File the cache is loaded from and saved to */
+  std::string _path;
+
+  /** The pipeline cache */
+  VkPipelineCache _cache = VK_NULL_HANDLE;
+
+  /**
+   * Reads the cache file. Returns an empty buffer if the file can't be read
+   * or was written by a different device or driver.
+   */
+  std::vector<char> _LoadCacheData();
+
+  /**
+   * Checks that @a data starts with a header written by this device and driver
+   */
+  bool _IsHeaderValid(const std::vector<char>& data);
+};
+
+ValiumPipelineCache::ValiumPipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path) {
+  _impl = new impl();
+  _impl->_physicalDevice = physicalDevice;
+  _impl->_device = device;
+  _impl->_path = path;
+
+  std::vector<char> data = _impl->_LoadCacheData();
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating pipeline cache with " << data.size() << " bytes" << std::endl;
+#endif
+  if (vkCreatePipelineCache(device, &createInfo, nullptr, &_impl->_cache) != VK_SUCCESS) {
+    delete _impl;
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+}
+
+ValiumPipelineCache::~ValiumPipelineCache() {
+  // A failed save only costs compile time on the next run, never throw from here
+  try {
+    Save();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  }
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying pipeline cache" << std::endl;
+#endif
+  vkDestroyPipelineCache(_impl->_device, _impl->_cache, nullptr);
+  delete _impl;
+}
+
+std::vector<char> ValiumPipelineCache::impl::_LoadCacheData() {
+  if (_path.empty()) {
+    return {};
+  }
+
+  std::ifstream file(_path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    // No cache yet, e.g. the first run
+    return {};
+  }
+
+  size_t fileSize = (size_t) file.tellg();
+  std::vector<char> buffer(fileSize);
+
+  file.seekg(0);
+  file.read(buffer.data(), fileSize);
+  if (!file) {
+    return {};
+  }
+
+  if (!_IsHeaderValid(buffer)) {
+#ifndef NDEBUG
+    std::cout << "Ignoring pipeline cache " << _path << " written by another device or driver" << std::endl;
+#endif
+    return {};
+  }
+
+  return buffer;
+}
+
+bool ValiumPipelineCache::impl::_IsHeaderValid(const std::vector<char>& data) {
+  if (data.size() < PIPELINE_CACHE_HEADER_SIZE) {
+    return false;
+  }
+
+  // The header is a packed array of uint32_t followed by the UUID bytes.
+  // Copy the fields out since the buffer isn't guaranteed to be aligned.
+  uint32_t header[4];
+  uint8_t uuid[VK_UUID_SIZE];
+  memcpy(header, data.data(), sizeof(header));
+  memcpy(uuid, data.data() + sizeof(header), VK_UUID_SIZE);
+
+  uint32_t headerSize = header[0];
+  uint32_t headerVersion = header[1];
+  uint32_t vendorID = header[2];
+  uint32_t deviceID = header[3];
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(_physicalDevice, &props);
+
+  return headerSize >= PIPELINE_CACHE_HEADER_SIZE &&
+         headerSize <= data.size() &&
+         headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         vendorID == props.vendorID &&
+         deviceID == props.deviceID &&
+         memcmp(uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void ValiumPipelineCache::Save() {
+  if (_impl->_path.empty()) {
+    return;
+  }
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(_impl->_device, _impl->_cache, &size, nullptr) != VK_SUCCESS) {
+    throw std::runtime_error("failed to get pipeline cache size!");
+  }
+
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(_impl->_device, _impl->_cache, &size, data.data()) != VK_SUCCESS) {
+    throw std::runtime_error("failed to get pipeline cache data!");
+  }
+
+  // Write next to the real file, then rename over it. rename() replaces
+  // the file in one step, so readers see either the old or the new cache.
+  std::string tmpPath = _impl->_path + ".tmp";
+  std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open pipeline cache for writing!");
+  }
+  file.write(data.data(), size);
+  file.close();
+  if (!file) {
+    std::remove(tmpPath.c_str());
+    throw std::runtime_error("failed to write pipeline cache!");
+  }
+
+  if (std::rename(tmpPath.c_str(), _impl->_path.c_str()) != 0) {
+    std::remove(tmpPath.c_str());
+    throw std::runtime_error("failed to replace pipeline cache!");
+  }
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Saved " << size << " bytes of pipeline cache to " << _impl->_path << std::endl;
+#endif
+}
+
+VkPipelineCache ValiumPipelineCache::GetVkPipelineCache() const {
+  return _impl->_cache;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+/**
+ * Wraps a VkPipelineCache that persists between runs.
+ *
+ * The cache is loaded from disk when constructed and written back when
+ * destroyed, so pipelines compiled by a previous run don't need to be
+ * compiled again. One cache is shared by every pipeline on a device.
+ */
+class ValiumPipelineCache
+{
+ public:
+  /**
+   * Creates the pipeline cache, seeding it from @a path if the file exists
+   * and its header matches this device. A missing, truncated or mismatched
+   * file is ignored and the cache starts out empty.
+   *
+   * @param[in] physicalDevice Device whose IDs and cache UUID must match the file header
+   * @param[in] device Logical device to create the cache on
+   * @param[in] path File to load from and save to. Empty disables persistence.
+   */
+  ValiumPipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+
+  /**
+   * Saves the cache with Save() and destroys it
+   */
+  ~ValiumPipelineCache();
+
+  /**
+   * Writes the cache contents to disk. The data is written to a temporary
+   * file which then replaces the cache file, so a crash mid-write never
+   * leaves a corrupt cache behind.
+   */
+  void Save();
+
+  /**
+   * @returns The vulkan pipeline cache to pass to pipeline creation
+   */
+  VkPipelineCache GetVkPipelineCache() const;
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -0,0 +1,264 @@
+#include "valium_pipeline_compiler.h"
+#include "valium_fixed_functions.h"
+#include "valium_thread_pool.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/**
+ * Progress of a single pipeline compile
+ */
+enum class ValiumPipelineState {
+  Pending,
+  Ready,
+  Failed
+};
+
+/**
+ * Shared between every handle to a pipeline and the worker compiling it
+ */
+struct ValiumPipelineJob {
+  /** Device the pipeline is compiled on */
+  const VkDevice device;
+
+  /** Description the pipeline is compiled from */
+  const ValiumPipelineDesc desc;
+
+  /** Hash of @a desc */
+  const uint64_t id;
+
+  /** The compiled pipeline. Only written before @a state becomes Ready */
+  VkPipeline pipeline = VK_NULL_HANDLE;
+
+  /** Read without locking so recording never blocks on a compile */
+  std::atomic<ValiumPipelineState> state{ValiumPipelineState::Pending};
+
+  /** Why the compile failed. Only written before @a state becomes Failed */
+  std::string error;
+
+  /** Guards waiting on @a finished */
+  std::mutex mutex;
+
+  /** Signaled when @a state leaves Pending */
+  std::condition_variable finished;
+
+  ValiumPipelineJob(VkDevice device, const ValiumPipelineDesc& desc) : device(device), desc(desc), id(desc.Hash()) {}
+
+  ~ValiumPipelineJob() {
+    if (pipeline != VK_NULL_HANDLE) {
+#ifdef SHOW_RESOURCE_ALLOCATION
+      std::cout << "Destroying a compiled graphics pipeline" << std::endl;
+#endif
+      vkDestroyPipeline(device, pipeline, nullptr);
+    }
+  }
+
+  /**
+   * Publishes the result of the compile and wakes any waiters
+   */
+  void Finish(ValiumPipelineState result) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      state.store(result, std::memory_order_release);
+    }
+    finished.notify_all();
+  }
+};
+
+struct ValiumPipelineCompiler::impl {
+  /** Device pipelines are compiled on */
+  VkDevice _device;
+
+  /** Cache shared by every compile. Owned by the device. */
+  VkPipelineCache _cache;
+
+  /** Workers running the compiles */
+  ValiumThreadPool* _pool = nullptr;
+};
+
+ValiumPipelineCompiler::ValiumPipelineCompiler(VkDevice device, VkPipelineCache cache, uint32_t threadCount) {
+  _impl = new impl();
+  _impl->_device = device;
+  _impl->_cache = cache;
+  _impl->_pool = new ValiumThreadPool(threadCount);
+}
+
+ValiumPipelineCompiler::~ValiumPipelineCompiler() {
+  // Finishes the queued compiles before joining the workers
+  delete _impl->_pool;
+  delete _impl;
+}
+
+ValiumPipelineHandle ValiumPipelineCompiler::Submit(const ValiumPipelineDesc& desc) {
+  ValiumPipelineHandle handle;
+  handle._job = std::make_shared<ValiumPipelineJob>(_impl->_device, desc);
+
+  VkPipelineCache cache = _impl->_cache;
+  std::shared_ptr<ValiumPipelineJob> job = handle._job;
+  _impl->_pool->Submit([job, cache]() {
+    try {
+      job->pipeline = Compile(job->device, cache, job->desc);
+      job->Finish(ValiumPipelineState::Ready);
+    } catch (const std::exception& e) {
+      job->error = e.what();
+      job->Finish(ValiumPipelineState::Failed);
+    }
+  });
+
+  return handle;
+}
+
+std::vector<ValiumPipelineHandle> ValiumPipelineCompiler::SubmitAll(const std::vector<ValiumPipelineDesc>& descs) {
+  std::vector<ValiumPipelineHandle> handles;
+  handles.reserve(descs.size());
+  for (const ValiumPipelineDesc& desc : descs) {
+    handles.push_back(Submit(desc));
+  }
+  return handles;
+}
+
+void ValiumPipelineCompiler::WaitIdle() {
+  _impl->_pool->WaitIdle();
+}
+
+// static
+VkPipeline ValiumPipelineCompiler::Compile(VkDevice device, VkPipelineCache cache, const ValiumPipelineDesc& desc) {
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  // Specialization data must outlive the create call, size them up front
+  // so pointers into them stay valid
+  std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+  std::vector<VkSpecializationInfo> specializationInfos(desc.stages.size());
+  std::vector<std::vector<VkSpecializationMapEntry>> specializationEntries(desc.stages.size());
+  std::vector<std::vector<uint32_t>> specializationData(desc.stages.size());
+  for (size_t i = 0; i < desc.stages.size(); i++) {
+    const ValiumShaderStage& stage = desc.stages[i];
+    VkPipelineShaderStageCreateInfo stageInfo{};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = stage.stage;
+    stageInfo.module = stage.module;
+    stageInfo.pName = stage.entryPoint.c_str();
+
+    if (!stage.specialization.empty()) {
+      for (const auto& constant : stage.specialization) {
+        VkSpecializationMapEntry entry{};
+        entry.constantID = constant.first;
+        entry.offset = static_cast<uint32_t>(specializationData[i].size() * sizeof(uint32_t));
+        entry.size = sizeof(uint32_t);
+        specializationEntries[i].push_back(entry);
+        specializationData[i].push_back(constant.second);
+      }
+      VkSpecializationInfo& info = specializationInfos[i];
+      info.mapEntryCount = static_cast<uint32_t>(specializationEntries[i].size());
+      info.pMapEntries = specializationEntries[i].data();
+      info.dataSize = specializationData[i].size() * sizeof(uint32_t);
+      info.pData = specializationData[i].data();
+      stageInfo.pSpecializationInfo = &info;
+    }
+    shaderStages.push_back(stageInfo);
+  }
+  pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+  pipelineInfo.pStages = shaderStages.data();
+
+  const ValiumFixedFunctionState& state = desc.fixedFunction;
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo = ValiumFixedFnInfo::VERTEX_INPUT_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+  vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = ValiumFixedFnInfo::VERTEX_ASSEMBLY_INFO;
+  inputAssemblyInfo.topology = state.topology;
+  pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+
+  // Viewport State
+  VkViewport viewport = ValiumFixedFnInfo::GetViewport(desc.extent.width, desc.extent.height);
+  VkRect2D scissor = ValiumFixedFnInfo::GetScissor(desc.extent);
+  VkPipelineViewportStateCreateInfo viewportStateCreateInfo;
+  if (desc.dynamicViewport) {
+    viewportStateCreateInfo = ValiumFixedFnInfo::GetDynamicViewportStateCreateInfo(1);
+  } else {
+    viewportStateCreateInfo = ValiumFixedFnInfo::GetViewportStateCreateInfo(viewport, scissor);
+  }
+
+  pipelineInfo.pViewportState = &viewportStateCreateInfo;
+
+  VkPipelineRasterizationStateCreateInfo rasterizerInfo = ValiumFixedFnInfo::RASTERIZER_INFO;
+  rasterizerInfo.polygonMode = state.polygonMode;
+  rasterizerInfo.cullMode = state.cullMode;
+  rasterizerInfo.frontFace = state.frontFace;
+  pipelineInfo.pRasterizationState = &rasterizerInfo;
+
+  VkPipelineMultisampleStateCreateInfo multisamplingInfo = ValiumFixedFnInfo::MULTISAMPLING_INFO;
+  multisamplingInfo.rasterizationSamples = state.samples;
+  pipelineInfo.pMultisampleState = &multisamplingInfo;
+
+  pipelineInfo.pDepthStencilState = nullptr; // Optional
+
+  VkPipelineColorBlendAttachmentState blendAttachment = ValiumFixedFnInfo::COLOR_BLEND_ATTACH_INFO;
+  blendAttachment.blendEnable = state.blendEnable ? VK_TRUE : VK_FALSE;
+  blendAttachment.srcColorBlendFactor = state.srcColorBlendFactor;
+  blendAttachment.dstColorBlendFactor = state.dstColorBlendFactor;
+  blendAttachment.colorBlendOp = state.colorBlendOp;
+  blendAttachment.srcAlphaBlendFactor = state.srcAlphaBlendFactor;
+  blendAttachment.dstAlphaBlendFactor = state.dstAlphaBlendFactor;
+  blendAttachment.alphaBlendOp = state.alphaBlendOp;
+  blendAttachment.colorWriteMask = state.colorWriteMask;
+  VkPipelineColorBlendStateCreateInfo blendInfo = ValiumFixedFnInfo::COLOR_BLEND_INFO;
+  blendInfo.pAttachments = &blendAttachment;
+  pipelineInfo.pColorBlendState = &blendInfo;
+  pipelineInfo.pDynamicState = desc.dynamicViewport ? &ValiumFixedFnInfo::DYNAMIC_STATE_INFO : nullptr;
+
+  pipelineInfo.layout = desc.layout;
+  pipelineInfo.renderPass = desc.renderPass;
+  pipelineInfo.subpass = desc.subpass;
+
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+  pipelineInfo.basePipelineIndex = -1; // Optional
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating a graphics pipeline" << std::endl;
+#endif
+  VkPipeline pipeline;
+  if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create graphics pipeline!");
+  }
+  return pipeline;
+}
+
+bool ValiumPipelineHandle::IsValid() const {
+  return _job != nullptr;
+}
+
+uint64_t ValiumPipelineHandle::GetId() const {
+  return _job ? _job->id : 0;
+}
+
+bool ValiumPipelineHandle::IsReady() const {
+  return _job && _job->state.load(std::memory_order_acquire) == ValiumPipelineState::Ready;
+}
+
+bool ValiumPipelineHandle::HasFailed() const {
+  return _job && _job->state.load(std::memory_order_acquire) == ValiumPipelineState::Failed;
+}
+
+VkPipeline ValiumPipelineHandle::Get() const {
+  return IsReady() ? _job->pipeline : VK_NULL_HANDLE;
+}
+
+void ValiumPipelineHandle::Wait() const {
+  if (!_job) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(_job->mutex);
+  _job->finished.wait(lock, [this] { return _job->state.load() != ValiumPipelineState::Pending; });
+}
+
+std::string ValiumPipelineHandle::GetError() const {
+  return HasFailed() ? _job->error : std::string();
+}
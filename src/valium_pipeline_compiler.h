@@ -0,0 +1,126 @@
+#pragma once
+
+#include "valium_pipeline_desc.h"
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ValiumPipelineJob;
+
+/**
+ * Refers to a pipeline that was submitted to a ValiumPipelineCompiler.
+ *
+ * Handles are cheap to copy. The pipeline is destroyed along with the last
+ * handle referring to it, so keep a handle for as long as the pipeline may
+ * be used by the GPU.
+ */
+class ValiumPipelineHandle
+{
+ public:
+  /**
+   * Creates a handle that doesn't refer to any pipeline
+   */
+  ValiumPipelineHandle() = default;
+
+  /**
+   * @returns true if this handle refers to a submitted pipeline
+   */
+  bool IsValid() const;
+
+  /**
+   * @returns the hash of the pipeline's description, see ValiumPipelineDesc::Hash()
+   */
+  uint64_t GetId() const;
+
+  /**
+   * @returns true once the pipeline has compiled successfully. Never blocks.
+   */
+  bool IsReady() const;
+
+  /**
+   * @returns true if compiling the pipeline failed, see GetError()
+   */
+  bool HasFailed() const;
+
+  /**
+   * @returns the pipeline, or VK_NULL_HANDLE while it is still compiling
+   * or if it failed. Never blocks, so it is safe to call while recording.
+   */
+  VkPipeline Get() const;
+
+  /**
+   * Blocks until the pipeline has either compiled or failed
+   */
+  void Wait() const;
+
+  /**
+   * @returns why compiling failed, empty unless HasFailed()
+   */
+  std::string GetError() const;
+
+ private:
+  friend class ValiumPipelineCompiler;
+  friend class ValiumPipelineRegistry;
+  std::shared_ptr<ValiumPipelineJob> _job;
+};
+
+/**
+ * Compiles graphics pipelines on a pool of worker threads.
+ *
+ * vkCreateGraphicsPipelines is safe to call from several threads at once,
+ * even with a shared pipeline cache, so each pipeline is compiled as its own
+ * job. Submitting a batch of pipelines up front keeps every core busy
+ * instead of compiling them one at a time on the render thread.
+ */
+class ValiumPipelineCompiler
+{
+ public:
+  /**
+   * Starts the worker threads
+   *
+   * @param[in] device Device to compile pipelines on
+   * @param[in] cache Pipeline cache shared by every compile, may be VK_NULL_HANDLE
+   * @param[in] threadCount Number of workers. 0 uses one per hardware thread.
+   */
+  ValiumPipelineCompiler(VkDevice device, VkPipelineCache cache, uint32_t threadCount = 0);
+
+  /**
+   * Waits for every submitted pipeline to finish compiling
+   */
+  ~ValiumPipelineCompiler();
+
+  /**
+   * Queues a pipeline to be compiled and returns immediately
+   *
+   * @param[in] desc Description of the pipeline
+   * @returns a handle that becomes ready once the pipeline has compiled
+   */
+  ValiumPipelineHandle Submit(const ValiumPipelineDesc& desc);
+
+  /**
+   * Queues every pipeline in @a descs, e.g. all material variants at startup
+   *
+   * @returns one handle per description, in the same order
+   */
+  std::vector<ValiumPipelineHandle> SubmitAll(const std::vector<ValiumPipelineDesc>& descs);
+
+  /**
+   * Blocks until every pipeline submitted so far has compiled or failed
+   */
+  void WaitIdle();
+
+  /**
+   * Compiles a pipeline on the calling thread
+   *
+   * @param[in] device Device to compile the pipeline on
+   * @param[in] cache Pipeline cache to use, may be VK_NULL_HANDLE
+   * @param[in] desc Description of the pipeline
+   * @returns the new pipeline, owned by the caller
+   */
+  static VkPipeline Compile(VkDevice device, VkPipelineCache cache, const ValiumPipelineDesc& desc);
+
+ private:
+  struct impl;
+  impl* _impl;
+};
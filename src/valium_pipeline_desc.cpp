@@ -0,0 +1,135 @@
+#include "valium_pipeline_desc.h"
+#include <tuple>
+
+/**
+ * Folds @a value into an FNV-1a hash one byte at a time
+ */
+static void HashValue(uint64_t& hash, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    hash ^= (value >> (i * 8)) & 0xff;
+    hash *= 1099511628211ull;
+  }
+}
+
+/**
+ * Folds @a text into an FNV-1a hash, including its length
+ */
+static void HashString(uint64_t& hash, const std::string& text) {
+  HashValue(hash, text.size());
+  for (char c : text) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+}
+
+bool ValiumFixedFunctionState::operator==(const ValiumFixedFunctionState& other) const {
+  auto tie = [](const ValiumFixedFunctionState& s) {
+    return std::make_tuple(s.topology, s.polygonMode, s.cullMode, s.frontFace, s.samples,
+                           s.blendEnable, s.srcColorBlendFactor, s.dstColorBlendFactor, s.colorBlendOp,
+                           s.srcAlphaBlendFactor, s.dstAlphaBlendFactor, s.alphaBlendOp, s.colorWriteMask);
+  };
+  return tie(*this) == tie(other);
+}
+
+uint64_t ValiumPipelineDesc::Hash() const {
+  uint64_t hash = 14695981039346656037ull;
+
+  HashValue(hash, stages.size());
+  for (const ValiumShaderStage& stage : stages) {
+    HashValue(hash, stage.stage);
+    HashValue(hash, stage.moduleHash);
+    HashString(hash, stage.entryPoint);
+    HashValue(hash, stage.specialization.size());
+    for (const auto& constant : stage.specialization) {
+      HashValue(hash, constant.first);
+      HashValue(hash, constant.second);
+    }
+  }
+
+  HashValue(hash, vertexBindings.size());
+  for (const VkVertexInputBindingDescription& binding : vertexBindings) {
+    HashValue(hash, binding.binding);
+    HashValue(hash, binding.stride);
+    HashValue(hash, binding.inputRate);
+  }
+
+  HashValue(hash, vertexAttributes.size());
+  for (const VkVertexInputAttributeDescription& attribute : vertexAttributes) {
+    HashValue(hash, attribute.location);
+    HashValue(hash, attribute.binding);
+    HashValue(hash, attribute.format);
+    HashValue(hash, attribute.offset);
+  }
+
+  HashValue(hash, fixedFunction.topology);
+  HashValue(hash, fixedFunction.polygonMode);
+  HashValue(hash, fixedFunction.cullMode);
+  HashValue(hash, fixedFunction.frontFace);
+  HashValue(hash, fixedFunction.samples);
+  HashValue(hash, fixedFunction.blendEnable);
+  HashValue(hash, fixedFunction.srcColorBlendFactor);
+  HashValue(hash, fixedFunction.dstColorBlendFactor);
+  HashValue(hash, fixedFunction.colorBlendOp);
+  HashValue(hash, fixedFunction.srcAlphaBlendFactor);
+  HashValue(hash, fixedFunction.dstAlphaBlendFactor);
+  HashValue(hash, fixedFunction.alphaBlendOp);
+  HashValue(hash, fixedFunction.colorWriteMask);
+
+  HashValue(hash, layoutKey);
+  HashValue(hash, renderPassKey);
+  HashValue(hash, subpass);
+  HashValue(hash, dynamicViewport);
+  // The extent only matters when it is baked in
+  if (!dynamicViewport) {
+    HashValue(hash, extent.width);
+    HashValue(hash, extent.height);
+  }
+
+  return hash;
+}
+
+bool ValiumPipelineDesc::operator==(const ValiumPipelineDesc& other) const {
+  if (stages.size() != other.stages.size() ||
+      vertexBindings.size() != other.vertexBindings.size() ||
+      vertexAttributes.size() != other.vertexAttributes.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < stages.size(); i++) {
+    if (stages[i].stage != other.stages[i].stage ||
+        stages[i].module != other.stages[i].module ||
+        stages[i].moduleHash != other.stages[i].moduleHash ||
+        stages[i].entryPoint != other.stages[i].entryPoint ||
+        stages[i].specialization != other.stages[i].specialization) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < vertexBindings.size(); i++) {
+    const VkVertexInputBindingDescription& a = vertexBindings[i];
+    const VkVertexInputBindingDescription& b = other.vertexBindings[i];
+    if (a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < vertexAttributes.size(); i++) {
+    const VkVertexInputAttributeDescription& a = vertexAttributes[i];
+    const VkVertexInputAttributeDescription& b = other.vertexAttributes[i];
+    if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset) {
+      return false;
+    }
+  }
+
+  if (dynamicViewport != other.dynamicViewport ||
+      (!dynamicViewport && (extent.width != other.extent.width || extent.height != other.extent.height))) {
+    return false;
+  }
+
+  return fixedFunction == other.fixedFunction &&
+         layout == other.layout &&
+         layoutKey == other.layoutKey &&
+         renderPass == other.renderPass &&
+         renderPassKey == other.renderPassKey &&
+         subpass == other.subpass;
+}
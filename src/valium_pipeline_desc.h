@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Specialization constant values keyed by constant_id. Every value is 32
+ * bits wide, which covers int, uint, float and bool (as VkBool32) constants.
+ */
+typedef std::map<uint32_t, uint32_t> ValiumSpecialization;
+
+/**
+ * Returns the bits of a float specialization constant value
+ */
+inline uint32_t ValiumSpecFloat(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/**
+ * One shader stage of a pipeline
+ */
+struct ValiumShaderStage {
+  /** Stage the module runs in */
+  VkShaderStageFlagBits stage;
+
+  /** The shader module, owned by a ValiumShaderCache */
+  VkShaderModule module;
+
+  /** Hash of @a module's SPIR-V, see ValiumShaderCache::GetHash() */
+  uint64_t moduleHash = 0;
+
+  /** Name of the entry point in @a module */
+  std::string entryPoint = "main";
+
+  /**
+   * Values for the module's specialization constants. Constants left out
+   * keep the default from the shader.
+   */
+  ValiumSpecialization specialization;
+};
+
+/**
+ * Fixed-function state of a pipeline. The defaults match the constants in
+ * ValiumFixedFnInfo.
+ */
+struct ValiumFixedFunctionState {
+  /** How vertices are assembled into primitives */
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  /** Whether polygons are filled or drawn as lines or points */
+  VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+
+  /** Faces that are discarded */
+  VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+
+  /** Winding order of front facing polygons */
+  VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+  /** Samples per pixel, must match the renderpass */
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+  /** Blends into the single color attachment when true, otherwise overwrites it */
+  bool blendEnable = false;
+
+  /** Factor the shader's color is multiplied by */
+  VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+
+  /** Factor the attachment's color is multiplied by */
+  VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+
+  /** Combines the two weighted colors */
+  VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+
+  /** Factor the shader's alpha is multiplied by */
+  VkBlendFactor srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+
+  /** Factor the attachment's alpha is multiplied by */
+  VkBlendFactor dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+
+  /** Combines the two weighted alphas */
+  VkBlendOp alphaBlendOp = VK_BLEND_OP_ADD;
+
+  /** Components written to the attachment */
+  VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+  bool operator==(const ValiumFixedFunctionState& other) const;
+};
+
+/**
+ * Everything needed to compile one graphics pipeline, as a value that can
+ * be hashed and compared.
+ *
+ * The shader modules, layout and renderpass are borrowed, they must stay
+ * alive until the pipeline has finished compiling. They're hashed through
+ * their content keys rather than their handles, so the hash is the same in
+ * every run, and a handle that is reused after its object was destroyed
+ * doesn't match pipelines built for the old object.
+ */
+struct ValiumPipelineDesc {
+  /** Shader stages, one per loaded shader */
+  std::vector<ValiumShaderStage> stages;
+
+  /** Vertex buffer bindings, empty when the vertex shader has no inputs */
+  std::vector<VkVertexInputBindingDescription> vertexBindings;
+
+  /** Vertex attributes read from @a vertexBindings */
+  std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+  /** Rasterization, multisample and blend state */
+  ValiumFixedFunctionState fixedFunction;
+
+  /** Layout the pipeline is created with */
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+
+  /** Content key of @a layout, see ValiumLayoutCache::GetKey() */
+  uint64_t layoutKey = 0;
+
+  /** Renderpass the pipeline will be used in */
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+
+  /** Content key of @a renderPass, see ValiumRenderPass::GetKey() */
+  uint64_t renderPassKey = 0;
+
+  /** Subpass of @a renderPass the pipeline will be used in */
+  uint32_t subpass = 0;
+
+  /**
+   * When true the viewport and scissor are dynamic state, otherwise they're
+   * baked in from @a extent
+   */
+  bool dynamicViewport = true;
+
+  /** Extent baked into the pipeline when @a dynamicViewport is false */
+  VkExtent2D extent = {0, 0};
+
+  /**
+   * 64 bit FNV-1a hash of every field that affects the compiled pipeline,
+   * with the keys standing in for the handles. Identical descriptions hash
+   * the same in every run, so the hash doubles as a compact pipeline ID to
+   * sort draws by.
+   */
+  uint64_t Hash() const;
+
+  bool operator==(const ValiumPipelineDesc& other) const;
+  bool operator!=(const ValiumPipelineDesc& other) const { return !(*this == other); }
+};
@@ -0,0 +1,105 @@
+#include "valium_pipeline_registry.h"
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <iterator>
+#include <vector>
+
+/**
+ * A pipeline along with the description it was requested with
+ */
+struct RegisteredPipeline {
+  /** Description the pipeline was compiled from */
+  ValiumPipelineDesc desc;
+
+  /** The registry's handle to the pipeline */
+  ValiumPipelineHandle handle;
+
+  /** Consecutive ReleaseUnused() calls that found no other handle */
+  uint32_t unusedFrames = 0;
+};
+
+struct ValiumPipelineRegistry::impl {
+  /** Compiler new pipelines are submitted to */
+  ValiumPipelineCompiler* _compiler;
+
+  /** Guards @a _pipelines and the counters */
+  std::mutex _mutex;
+
+  /**
+   * Registered pipelines keyed by the hash of their description. Each
+   * bucket holds the full descriptions so hash collisions can't alias.
+   */
+  std::unordered_map<uint64_t, std::vector<RegisteredPipeline>> _pipelines;
+
+  /** Number of distinct pipelines */
+  size_t _count = 0;
+
+  /** Number of requests that reused a pipeline */
+  size_t _hits = 0;
+};
+
+ValiumPipelineRegistry::ValiumPipelineRegistry(ValiumPipelineCompiler* compiler) {
+  _impl = new impl();
+  _impl->_compiler = compiler;
+}
+
+ValiumPipelineRegistry::~ValiumPipelineRegistry() {
+  // Pipelines still compiling are destroyed by their job once it finishes
+  delete _impl;
+}
+
+ValiumPipelineHandle ValiumPipelineRegistry::Get(const ValiumPipelineDesc& desc) {
+  uint64_t hash = desc.Hash();
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto& bucket = _impl->_pipelines[hash];
+  for (RegisteredPipeline& entry : bucket) {
+    if (entry.desc == desc) {
+      _impl->_hits++;
+      entry.unusedFrames = 0;
+      return entry.handle;
+    }
+  }
+
+  ValiumPipelineHandle handle = _impl->_compiler->Submit(desc);
+  bucket.push_back({desc, handle});
+  _impl->_count++;
+  return handle;
+}
+
+size_t ValiumPipelineRegistry::ReleaseUnused(uint32_t frames) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  size_t released = 0;
+  for (auto bucket = _impl->_pipelines.begin(); bucket != _impl->_pipelines.end(); ) {
+    auto& entries = bucket->second;
+    for (auto entry = entries.begin(); entry != entries.end(); ) {
+      // Handles are only copied out under the lock, so a count of one
+      // can't go up while it is held
+      bool compiling = !entry->handle.IsReady() && !entry->handle.HasFailed();
+      if (compiling || entry->handle._job.use_count() > 1) {
+        entry->unusedFrames = 0;
+        ++entry;
+      } else if (++entry->unusedFrames > frames) {
+        // Dropping the last handle destroys the pipeline
+        entry = entries.erase(entry);
+        _impl->_count--;
+        released++;
+      } else {
+        ++entry;
+      }
+    }
+    bucket = entries.empty() ? _impl->_pipelines.erase(bucket) : std::next(bucket);
+  }
+  return released;
+}
+
+size_t ValiumPipelineRegistry::GetPipelineCount() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  return _impl->_count;
+}
+
+size_t ValiumPipelineRegistry::GetHitCount() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  return _impl->_hits;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "valium_pipeline_compiler.h"
+#include <cstddef>
+
+/**
+ * Device wide registry of graphics pipelines, keyed by their description.
+ *
+ * Requesting a description that was requested before returns the same
+ * pipeline, compiled or still compiling, instead of compiling it again.
+ * The registry keeps a pipeline alive while any handle to it is held and
+ * for a few frames after the last one is dropped, see ReleaseUnused().
+ * Safe to use from several threads.
+ */
+class ValiumPipelineRegistry
+{
+ public:
+  /**
+   * @param[in] compiler Compiler new pipelines are submitted to
+   */
+  ValiumPipelineRegistry(ValiumPipelineCompiler* compiler);
+
+  /**
+   * Releases every registered pipeline
+   */
+  ~ValiumPipelineRegistry();
+
+  /**
+   * Returns the pipeline for @a desc, submitting it to the compiler the
+   * first time it is seen. Never blocks on a compile.
+   */
+  ValiumPipelineHandle Get(const ValiumPipelineDesc& desc);
+
+  /**
+   * Releases pipelines that have finished compiling and that no handle
+   * outside the registry has referred to for more than @a frames calls.
+   * Call once per frame with the number of frames in flight, so a pipeline
+   * dropped while a frame still uses it outlives that frame. A description
+   * requested again within that time gets its pipeline back.
+   *
+   * @returns the number of pipelines released
+   */
+  size_t ReleaseUnused(uint32_t frames);
+
+  /**
+   * @returns the number of distinct pipelines currently registered
+   */
+  size_t GetPipelineCount();
+
+  /**
+   * @returns the number of requests answered with an existing pipeline
+   */
+  size_t GetHitCount();
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -11,26 +11,70 @@ QueueFamilyIndices ValiumQueue::GetQueueIndices(const VkPhysicalDevice device, c
   std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-  // Iterate over the available queues and fill in the indices struct
-  int i = 0;
-  for (const auto& queueFamily : queueFamilies) {
-    if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-      indices.graphicsFamily = i;
+  // Prefer one family that both renders and presents. Splitting the roles
+  // costs an ownership transfer of every swapchain image each frame.
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    if (!(queueFamilies[family].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      continue;
+    }
+
+    // Headless devices have no surface to present to, so there is no
+    // present family to look for.
+    if (surface == VK_NULL_HANDLE) {
+      indices.graphicsFamily = family;
+      break;
     }
 
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+    vkGetPhysicalDeviceSurfaceSupportKHR(device, family, surface, &presentSupport);
     if (presentSupport) {
-      indices.presentFamily = i;
+      indices.graphicsFamily = family;
+      indices.presentFamily = family;
+      break;
     }
+  }
 
-    if (surface == VK_NULL_HANDLE && indices.hasGraphics()) {
-      break;
-    } else if (indices.isComplete()) {
-      break;
+  // Otherwise fall back to the first family for each role
+  for (uint32_t family = 0; family < queueFamilyCount && !indices.isComplete(surface); family++) {
+    if (!indices.graphicsFamily.has_value() && (queueFamilies[family].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      indices.graphicsFamily = family;
     }
+    if (surface != VK_NULL_HANDLE && !indices.presentFamily.has_value()) {
+      VkBool32 presentSupport = false;
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, family, surface, &presentSupport);
+      if (presentSupport) {
+        indices.presentFamily = family;
+      }
+    }
+  }
 
-    i++;
+  // Dedicated families map to separate hardware engines, so work submitted
+  // to them runs in parallel with the graphics queue
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    VkQueueFlags flags = queueFamilies[family].queueFlags;
+    if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && !indices.transferFamily.has_value()) {
+      indices.transferFamily = family;
+    }
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !indices.computeFamily.has_value()) {
+      indices.computeFamily = family;
+    }
   }
   return indices;
 }
+
+ValiumQueueHandle::ValiumQueueHandle(VkQueue queue, uint32_t family, float priority) : _queue(queue), _family(family), _priority(priority) {}
+
+VkResult ValiumQueueHandle::Submit(uint32_t submitCount, const VkSubmitInfo* submits, VkFence fence) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return vkQueueSubmit(_queue, submitCount, submits, fence);
+}
+
+VkResult ValiumQueueHandle::Present(const VkPresentInfoKHR* presentInfo) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return vkQueuePresentKHR(_queue, presentInfo);
+}
+
+VkResult ValiumQueueHandle::WaitIdle() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return vkQueueWaitIdle(_queue);
+}
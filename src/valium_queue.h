@@ -2,6 +2,7 @@
 
 #include <vulkan/vulkan.h>
 #include <optional>
+#include <mutex>
 
 /**
  * Contains information for a desired queue family's index in a physical device
@@ -10,6 +11,18 @@ struct QueueFamilyIndices {
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentFamily;
 
+  /**
+   * Family with transfer but no graphics or compute support, i.e. the
+   * device's copy engine. Empty if the device has none.
+   */
+  std::optional<uint32_t> transferFamily;
+
+  /**
+   * Family with compute but no graphics support, which runs alongside the
+   * graphics queue. Empty if the device has none.
+   */
+  std::optional<uint32_t> computeFamily;
+
   bool isComplete() {
     return graphicsFamily.has_value() && presentFamily.has_value();
   }
@@ -17,6 +30,109 @@ struct QueueFamilyIndices {
   bool hasGraphics() {
     return graphicsFamily.has_value();
   }
+
+  /**
+   * True if rendering and presenting happen on different families, so
+   * swapchain images need an ownership transfer before each present
+   */
+  bool isPresentSplit() const {
+    return presentFamily.has_value() && presentFamily != graphicsFamily;
+  }
+
+  /**
+   * Family transfers should be submitted to, the graphics family if there
+   * is no dedicated transfer family
+   */
+  uint32_t transferOrGraphics() const {
+    return transferFamily.value_or(graphicsFamily.value());
+  }
+
+  /**
+   * Family compute work should be submitted to, the graphics family if
+   * there is no dedicated compute family
+   */
+  uint32_t computeOrGraphics() const {
+    return computeFamily.value_or(graphicsFamily.value());
+  }
+
+  /**
+   * Checks that the families needed for the given surface were found.
+   * A headless device (@a surface is VK_NULL_HANDLE) only needs graphics.
+   */
+  bool isComplete(const VkSurfaceKHR surface) {
+    return surface == VK_NULL_HANDLE ? hasGraphics() : isComplete();
+  }
+};
+
+/**
+ * What a queue is used for, see ValiumDevice::GetQueue()
+ */
+enum class ValiumQueueRole {
+  /** Rendering, the graphics family */
+  Graphics,
+
+  /** Presenting to the surface, the present family */
+  Present,
+
+  /** Copies, the dedicated transfer family if there is one */
+  Transfer,
+
+  /** Compute dispatches, the dedicated compute family if there is one */
+  Compute
+};
+
+/**
+ * One VkQueue and the lock around it.
+ *
+ * Vulkan requires submissions to a queue to be externally synchronized.
+ * Every queue has its own lock, so threads submitting to different queues
+ * never wait on each other.
+ */
+class ValiumQueueHandle
+{
+ public:
+  /**
+   * @param[in] queue Queue retrieved with vkGetDeviceQueue()
+   * @param[in] family Family the queue belongs to
+   * @param[in] priority Priority the queue was created with
+   */
+  ValiumQueueHandle(VkQueue queue, uint32_t family, float priority);
+
+  /**
+   * Calls vkQueueSubmit() while holding the queue's lock
+   */
+  VkResult Submit(uint32_t submitCount, const VkSubmitInfo* submits, VkFence fence);
+
+  /**
+   * Calls vkQueuePresentKHR() while holding the queue's lock
+   */
+  VkResult Present(const VkPresentInfoKHR* presentInfo);
+
+  /**
+   * Calls vkQueueWaitIdle() while holding the queue's lock
+   */
+  VkResult WaitIdle();
+
+  /**
+   * @returns the queue. Submitting to it directly bypasses the lock.
+   */
+  VkQueue GetVkQueue() const { return _queue; }
+
+  /**
+   * @returns the family the queue belongs to
+   */
+  uint32_t GetFamily() const { return _family; }
+
+  /**
+   * @returns the priority the queue was created with
+   */
+  float GetPriority() const { return _priority; }
+
+ private:
+  VkQueue _queue;
+  uint32_t _family;
+  float _priority;
+  std::mutex _mutex;
 };
 
 /**
@@ -29,7 +145,8 @@ class ValiumQueue
   /**
    * Returns the queue family indices for the given @a device
    * @param[in] device The device to read queue information for.
-   * @param[in] surface The surface to use if checking for a presentation queue
+   * @param[in] surface The surface to use if checking for a presentation queue.
+   *                    Pass VK_NULL_HANDLE to skip present queue selection.
    * @returns QueueFamilyIndices object containing indices of interest
    */
   static QueueFamilyIndices GetQueueIndices(const VkPhysicalDevice device, const VkSurfaceKHR surface);
@@ -0,0 +1,530 @@
+#include "valium_reflection.h"
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+/** SPIR-V opcodes read by the reflection */
+enum SpvOp : uint32_t {
+  OP_ENTRY_POINT = 15,
+  OP_TYPE_BOOL = 20,
+  OP_TYPE_INT = 21,
+  OP_TYPE_FLOAT = 22,
+  OP_TYPE_VECTOR = 23,
+  OP_TYPE_MATRIX = 24,
+  OP_TYPE_IMAGE = 25,
+  OP_TYPE_SAMPLER = 26,
+  OP_TYPE_SAMPLED_IMAGE = 27,
+  OP_TYPE_ARRAY = 28,
+  OP_TYPE_RUNTIME_ARRAY = 29,
+  OP_TYPE_STRUCT = 30,
+  OP_TYPE_POINTER = 32,
+  OP_CONSTANT = 43,
+  OP_SPEC_CONSTANT_TRUE = 48,
+  OP_SPEC_CONSTANT_FALSE = 49,
+  OP_SPEC_CONSTANT = 50,
+  OP_SPEC_CONSTANT_COMPOSITE = 51,
+  OP_SPEC_CONSTANT_OP = 52,
+  OP_VARIABLE = 59,
+  OP_DECORATE = 71,
+  OP_MEMBER_DECORATE = 72
+};
+
+/** SPIR-V decorations read by the reflection */
+enum SpvDecoration : uint32_t {
+  DECORATION_SPEC_ID = 1,
+  DECORATION_BLOCK = 2,
+  DECORATION_BUFFER_BLOCK = 3,
+  DECORATION_ARRAY_STRIDE = 6,
+  DECORATION_MATRIX_STRIDE = 7,
+  DECORATION_BUILT_IN = 11,
+  DECORATION_LOCATION = 30,
+  DECORATION_BINDING = 33,
+  DECORATION_DESCRIPTOR_SET = 34,
+  DECORATION_OFFSET = 35
+};
+
+/** SPIR-V storage classes read by the reflection */
+enum SpvStorageClass : uint32_t {
+  STORAGE_UNIFORM_CONSTANT = 0,
+  STORAGE_INPUT = 1,
+  STORAGE_UNIFORM = 2,
+  STORAGE_PUSH_CONSTANT = 9,
+  STORAGE_STORAGE_BUFFER = 12
+};
+
+/** SPIR-V image dimensions that change the descriptor type */
+#define SPV_DIM_BUFFER 5
+#define SPV_DIM_SUBPASS_DATA 6
+
+/** First word of every SPIR-V module */
+#define SPIRV_MAGIC 0x07230203u
+
+/** Number of words in the SPIR-V header */
+#define SPIRV_HEADER_WORDS 5
+
+/**
+ * Everything the reflection needs to know about one result ID
+ */
+struct SpvId {
+  /** Opcode that declared the ID */
+  uint32_t opcode = 0;
+
+  /** Operands of the declaration after the result ID */
+  std::vector<uint32_t> operands;
+
+  /** Decorations on the ID, keyed by decoration with its first literal */
+  std::unordered_map<uint32_t, uint32_t> decorations;
+
+  /** Offset decoration of each struct member */
+  std::unordered_map<uint32_t, uint32_t> memberOffsets;
+
+  /** MatrixStride decoration of each struct member */
+  std::unordered_map<uint32_t, uint32_t> memberMatrixStrides;
+
+  bool Has(uint32_t decoration) const { return decorations.count(decoration) != 0; }
+};
+
+/**
+ * Walks the instructions of a module and answers questions about its types
+ */
+struct SpvModule {
+  /** Every declared or decorated ID */
+  std::unordered_map<uint32_t, SpvId> ids;
+
+  /** Execution model of the first entry point */
+  uint32_t executionModel = 0;
+
+  /** IDs of the module's variables */
+  std::vector<uint32_t> variables;
+
+  /** Values overriding the defaults of specialization constants, keyed by SpecId */
+  ValiumSpecialization specialization;
+
+  SpvModule(const uint32_t* code, size_t wordCount);
+
+  const SpvId& Get(uint32_t id) const;
+
+  /**
+   * Value of an integer constant. Specialization constants give their
+   * value in @a specialization, or their default if it isn't set there.
+   */
+  uint32_t ConstantValue(uint32_t id) const;
+
+  /**
+   * Follows pointers and arrays down to the underlying type, multiplying
+   * the array lengths into @a count. Runtime arrays give a count of 0.
+   */
+  uint32_t Unwrap(uint32_t type, uint32_t& count) const;
+
+  /**
+   * Size of @a type in bytes as laid out in a buffer block
+   */
+  uint32_t SizeOf(uint32_t type, uint32_t matrixStride = 0) const;
+
+  /**
+   * Descriptor type of a variable's underlying type
+   */
+  VkDescriptorType DescriptorType(uint32_t storageClass, uint32_t type) const;
+
+  /**
+   * Vertex attribute format of an input variable's type
+   */
+  VkFormat VertexFormat(uint32_t type) const;
+};
+
+SpvModule::SpvModule(const uint32_t* code, size_t wordCount) {
+  if (wordCount < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+    throw std::runtime_error("shader is not valid SPIR-V!");
+  }
+
+  bool foundEntryPoint = false;
+  for (size_t i = SPIRV_HEADER_WORDS; i < wordCount; ) {
+    uint32_t opcode = code[i] & 0xffff;
+    uint32_t length = code[i] >> 16;
+    if (length == 0 || i + length > wordCount) {
+      throw std::runtime_error("shader is not valid SPIR-V!");
+    }
+    const uint32_t* operands = code + i + 1;
+    uint32_t operandCount = length - 1;
+
+    switch (opcode) {
+      case OP_ENTRY_POINT:
+        if (!foundEntryPoint && operandCount >= 1) {
+          executionModel = operands[0];
+          foundEntryPoint = true;
+        }
+        break;
+      case OP_DECORATE:
+        if (operandCount >= 2) {
+          ids[operands[0]].decorations[operands[1]] = operandCount >= 3 ? operands[2] : 0;
+        }
+        break;
+      case OP_MEMBER_DECORATE:
+        if (operandCount >= 4 && operands[2] == DECORATION_OFFSET) {
+          ids[operands[0]].memberOffsets[operands[1]] = operands[3];
+        } else if (operandCount >= 4 && operands[2] == DECORATION_MATRIX_STRIDE) {
+          ids[operands[0]].memberMatrixStrides[operands[1]] = operands[3];
+        }
+        break;
+      case OP_TYPE_BOOL:
+      case OP_TYPE_INT:
+      case OP_TYPE_FLOAT:
+      case OP_TYPE_VECTOR:
+      case OP_TYPE_MATRIX:
+      case OP_TYPE_IMAGE:
+      case OP_TYPE_SAMPLER:
+      case OP_TYPE_SAMPLED_IMAGE:
+      case OP_TYPE_ARRAY:
+      case OP_TYPE_RUNTIME_ARRAY:
+      case OP_TYPE_STRUCT:
+      case OP_TYPE_POINTER:
+        if (operandCount >= 1) {
+          SpvId& type = ids[operands[0]];
+          type.opcode = opcode;
+          type.operands.assign(operands + 1, operands + operandCount);
+        }
+        break;
+      case OP_CONSTANT:
+      case OP_SPEC_CONSTANT_TRUE:
+      case OP_SPEC_CONSTANT_FALSE:
+      case OP_SPEC_CONSTANT:
+      case OP_SPEC_CONSTANT_COMPOSITE:
+      case OP_SPEC_CONSTANT_OP:
+      case OP_VARIABLE:
+        // Result type comes before the result ID
+        if (operandCount >= 2) {
+          SpvId& value = ids[operands[1]];
+          value.opcode = opcode;
+          value.operands.assign(operands, operands + operandCount);
+          value.operands.erase(value.operands.begin() + 1);
+          if (opcode == OP_VARIABLE) {
+            variables.push_back(operands[1]);
+          }
+        }
+        break;
+      default:
+        break;
+    }
+    i += length;
+  }
+
+  if (!foundEntryPoint) {
+    throw std::runtime_error("shader has no entry point!");
+  }
+}
+
+const SpvId& SpvModule::Get(uint32_t id) const {
+  auto it = ids.find(id);
+  if (it == ids.end()) {
+    throw std::runtime_error("shader references an undeclared id!");
+  }
+  return it->second;
+}
+
+uint32_t SpvModule::ConstantValue(uint32_t id) const {
+  const SpvId& info = Get(id);
+  // Result type, value
+  if (info.opcode == OP_SPEC_CONSTANT && info.Has(DECORATION_SPEC_ID)) {
+    auto value = specialization.find(info.decorations.at(DECORATION_SPEC_ID));
+    if (value != specialization.end()) {
+      return value->second;
+    }
+  }
+  if ((info.opcode == OP_CONSTANT || info.opcode == OP_SPEC_CONSTANT) && info.operands.size() >= 2) {
+    return info.operands[1];
+  }
+  // A length computed from specialization constants isn't known until the
+  // pipeline is created
+  throw std::runtime_error("can't read shader constant!");
+}
+
+uint32_t SpvModule::Unwrap(uint32_t type, uint32_t& count) const {
+  count = 1;
+  while (true) {
+    const SpvId& info = Get(type);
+    if (info.opcode == OP_TYPE_POINTER) {
+      // Storage class, pointee
+      type = info.operands.at(1);
+    } else if (info.opcode == OP_TYPE_ARRAY) {
+      // Element type, length constant
+      count *= ConstantValue(info.operands.at(1));
+      type = info.operands.at(0);
+    } else if (info.opcode == OP_TYPE_RUNTIME_ARRAY) {
+      count = 0;
+      type = info.operands.at(0);
+    } else {
+      return type;
+    }
+  }
+}
+
+uint32_t SpvModule::SizeOf(uint32_t type, uint32_t matrixStride) const {
+  const SpvId& info = Get(type);
+  switch (info.opcode) {
+    case OP_TYPE_INT:
+    case OP_TYPE_FLOAT:
+      return info.operands.at(0) / 8;
+    case OP_TYPE_VECTOR:
+      return SizeOf(info.operands.at(0)) * info.operands.at(1);
+    case OP_TYPE_MATRIX: {
+      uint32_t stride = matrixStride != 0 ? matrixStride : SizeOf(info.operands.at(0));
+      return stride * info.operands.at(1);
+    }
+    case OP_TYPE_ARRAY: {
+      uint32_t length = ConstantValue(info.operands.at(1));
+      auto stride = info.decorations.find(DECORATION_ARRAY_STRIDE);
+      uint32_t elementSize = stride != info.decorations.end() ? stride->second : SizeOf(info.operands.at(0), matrixStride);
+      return elementSize * length;
+    }
+    case OP_TYPE_RUNTIME_ARRAY:
+      return 0;
+    case OP_TYPE_STRUCT: {
+      uint32_t size = 0;
+      for (uint32_t member = 0; member < info.operands.size(); member++) {
+        auto offset = info.memberOffsets.find(member);
+        auto stride = info.memberMatrixStrides.find(member);
+        uint32_t memberOffset = offset != info.memberOffsets.end() ? offset->second : size;
+        uint32_t memberStride = stride != info.memberMatrixStrides.end() ? stride->second : 0;
+        size = std::max(size, memberOffset + SizeOf(info.operands[member], memberStride));
+      }
+      return size;
+    }
+    default:
+      throw std::runtime_error("can't size shader type!");
+  }
+}
+
+VkDescriptorType SpvModule::DescriptorType(uint32_t storageClass, uint32_t type) const {
+  const SpvId& info = Get(type);
+  if (storageClass == STORAGE_STORAGE_BUFFER) {
+    return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  }
+  if (storageClass == STORAGE_UNIFORM) {
+    // Older SPIR-V marks storage buffers as BufferBlock in the Uniform class
+    return info.Has(DECORATION_BUFFER_BLOCK) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  }
+
+  switch (info.opcode) {
+    case OP_TYPE_SAMPLER:
+      return VK_DESCRIPTOR_TYPE_SAMPLER;
+    case OP_TYPE_SAMPLED_IMAGE:
+      return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    case OP_TYPE_IMAGE: {
+      // Sampled type, dim, depth, arrayed, ms, sampled
+      uint32_t dim = info.operands.at(1);
+      bool storage = info.operands.at(5) == 2;
+      if (dim == SPV_DIM_SUBPASS_DATA) {
+        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      }
+      if (dim == SPV_DIM_BUFFER) {
+        return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      }
+      return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    }
+    default:
+      throw std::runtime_error("unsupported descriptor type in shader!");
+  }
+}
+
+VkFormat SpvModule::VertexFormat(uint32_t type) const {
+  const SpvId& info = Get(type);
+  uint32_t components = 1;
+  uint32_t scalarType = type;
+  if (info.opcode == OP_TYPE_VECTOR) {
+    scalarType = info.operands.at(0);
+    components = info.operands.at(1);
+  }
+
+  const SpvId& scalar = Get(scalarType);
+  if (scalar.operands.at(0) != 32 || components < 1 || components > 4) {
+    throw std::runtime_error("unsupported vertex input type in shader!");
+  }
+
+  static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+  static const VkFormat intFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+  static const VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+  if (scalar.opcode == OP_TYPE_FLOAT) {
+    return floatFormats[components - 1];
+  }
+  if (scalar.opcode == OP_TYPE_INT) {
+    // Width, signedness
+    return scalar.operands.at(1) ? intFormats[components - 1] : uintFormats[components - 1];
+  }
+  throw std::runtime_error("unsupported vertex input type in shader!");
+}
+
+/**
+ * Maps a SPIR-V execution model to its shader stage
+ */
+static VkShaderStageFlagBits StageOf(uint32_t executionModel) {
+  switch (executionModel) {
+    case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+    default: return VK_SHADER_STAGE_ALL;
+  }
+}
+
+// static
+ShaderReflection ValiumReflection::Reflect(const uint32_t* code, size_t size, const ValiumSpecialization& specialization) {
+  SpvModule module(code, size / sizeof(uint32_t));
+  module.specialization = specialization;
+
+  ShaderReflection reflection;
+  reflection.stage = StageOf(module.executionModel);
+
+  // Vertex inputs by location, packed once they're all known
+  std::map<uint32_t, VkFormat> inputs;
+
+  for (uint32_t id : module.variables) {
+    const SpvId& variable = module.Get(id);
+    // Result type, storage class
+    uint32_t pointerType = variable.operands.at(0);
+    uint32_t storageClass = variable.operands.at(1);
+
+    // Function, private, output and workgroup variables aren't part of the
+    // interface, and their types may be ones the reflection doesn't size
+    switch (storageClass) {
+      case STORAGE_UNIFORM_CONSTANT:
+      case STORAGE_INPUT:
+      case STORAGE_UNIFORM:
+      case STORAGE_PUSH_CONSTANT:
+      case STORAGE_STORAGE_BUFFER:
+        break;
+      default:
+        continue;
+    }
+
+    uint32_t count;
+    uint32_t type = module.Unwrap(pointerType, count);
+
+    switch (storageClass) {
+      case STORAGE_UNIFORM_CONSTANT:
+      case STORAGE_UNIFORM:
+      case STORAGE_STORAGE_BUFFER: {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = variable.Has(DECORATION_BINDING) ? variable.decorations.at(DECORATION_BINDING) : 0;
+        binding.descriptorType = module.DescriptorType(storageClass, type);
+        binding.descriptorCount = count;
+        binding.stageFlags = reflection.stage;
+        uint32_t set = variable.Has(DECORATION_DESCRIPTOR_SET) ? variable.decorations.at(DECORATION_DESCRIPTOR_SET) : 0;
+        reflection.sets[set].push_back(binding);
+        if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+          reflection.uniformSizes[set][binding.binding] = module.SizeOf(type);
+        }
+        break;
+      }
+      case STORAGE_PUSH_CONSTANT: {
+        VkPushConstantRange range{};
+        range.stageFlags = reflection.stage;
+        range.offset = 0;
+        range.size = module.SizeOf(type);
+        reflection.pushConstants.push_back(range);
+        break;
+      }
+      case STORAGE_INPUT:
+        if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT &&
+            variable.Has(DECORATION_LOCATION) && !variable.Has(DECORATION_BUILT_IN)) {
+          inputs[variable.decorations.at(DECORATION_LOCATION)] = module.VertexFormat(type);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  for (auto& set : reflection.sets) {
+    std::sort(set.second.begin(), set.second.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+      return a.binding < b.binding;
+    });
+  }
+
+  for (auto& input : inputs) {
+    VkVertexInputAttributeDescription attribute{};
+    attribute.location = input.first;
+    attribute.binding = 0;
+    attribute.format = input.second;
+    attribute.offset = reflection.vertexStride;
+    reflection.vertexAttributes.push_back(attribute);
+
+    switch (input.second) {
+      case VK_FORMAT_R32_SFLOAT: case VK_FORMAT_R32_SINT: case VK_FORMAT_R32_UINT:
+        reflection.vertexStride += 4;
+        break;
+      case VK_FORMAT_R32G32_SFLOAT: case VK_FORMAT_R32G32_SINT: case VK_FORMAT_R32G32_UINT:
+        reflection.vertexStride += 8;
+        break;
+      case VK_FORMAT_R32G32B32_SFLOAT: case VK_FORMAT_R32G32B32_SINT: case VK_FORMAT_R32G32B32_UINT:
+        reflection.vertexStride += 12;
+        break;
+      default:
+        reflection.vertexStride += 16;
+        break;
+    }
+  }
+
+  return reflection;
+}
+
+// static
+ShaderReflection ValiumReflection::Merge(const std::vector<const ShaderReflection*>& stages) {
+  ShaderReflection merged;
+  merged.stage = static_cast<VkShaderStageFlagBits>(0);
+
+  VkPushConstantRange push{};
+  uint32_t pushEnd = 0;
+
+  for (const ShaderReflection* stage : stages) {
+    for (const auto& set : stage->sets) {
+      std::vector<VkDescriptorSetLayoutBinding>& bindings = merged.sets[set.first];
+      for (const VkDescriptorSetLayoutBinding& binding : set.second) {
+        auto existing = std::find_if(bindings.begin(), bindings.end(), [&](const VkDescriptorSetLayoutBinding& b) {
+          return b.binding == binding.binding;
+        });
+        if (existing == bindings.end()) {
+          bindings.push_back(binding);
+        } else if (existing->descriptorType != binding.descriptorType) {
+          throw std::runtime_error("shader stages disagree on a descriptor binding!");
+        } else {
+          existing->stageFlags |= binding.stageFlags;
+          existing->descriptorCount = std::max(existing->descriptorCount, binding.descriptorCount);
+        }
+      }
+    }
+
+    for (const auto& set : stage->uniformSizes) {
+      for (const auto& block : set.second) {
+        uint32_t& size = merged.uniformSizes[set.first][block.first];
+        size = std::max(size, block.second);
+      }
+    }
+
+    for (const VkPushConstantRange& range : stage->pushConstants) {
+      push.offset = push.stageFlags == 0 ? range.offset : std::min(push.offset, range.offset);
+      pushEnd = std::max(pushEnd, range.offset + range.size);
+      push.stageFlags |= range.stageFlags;
+    }
+
+    if (stage->stage == VK_SHADER_STAGE_VERTEX_BIT) {
+      merged.vertexAttributes = stage->vertexAttributes;
+      merged.vertexStride = stage->vertexStride;
+    }
+  }
+
+  if (push.stageFlags != 0) {
+    push.size = pushEnd - push.offset;
+    merged.pushConstants.push_back(push);
+  }
+
+  for (auto& set : merged.sets) {
+    std::sort(set.second.begin(), set.second.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+      return a.binding < b.binding;
+    });
+  }
+
+  return merged;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "valium_pipeline_desc.h"
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/**
+ * Resource interface of one shader, read from its SPIR-V
+ */
+struct ShaderReflection {
+  /** Stage of the shader's entry point */
+  VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+
+  /** Bindings used by the shader, keyed by descriptor set and sorted by binding */
+  std::map<uint32_t, std::vector<VkDescriptorSetLayoutBinding>> sets;
+
+  /** Size in bytes of each uniform block, keyed by descriptor set then binding */
+  std::map<uint32_t, std::map<uint32_t, uint32_t>> uniformSizes;
+
+  /** Push constant block used by the shader, at most one */
+  std::vector<VkPushConstantRange> pushConstants;
+
+  /**
+   * Vertex inputs, only filled in for vertex shaders. Every attribute is
+   * read from binding 0, tightly packed in location order.
+   */
+  std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+  /** Stride of binding 0, the sum of the attribute sizes */
+  uint32_t vertexStride = 0;
+};
+
+/**
+ * Minimal SPIR-V reflection, enough to derive pipeline layouts and vertex
+ * input state from the shaders instead of writing them by hand.
+ */
+class ValiumReflection
+{
+ public:
+  /**
+   * Reads the entry point, descriptor bindings, push constants and vertex
+   * inputs of a shader. Arrays sized by a specialization constant are
+   * reflected with its value in @a specialization, or with the constant's
+   * default value if it isn't set there.
+   *
+   * @param[in] code SPIR-V words
+   * @param[in] size Size of @a code in bytes
+   * @param[in] specialization Constants the pipeline will be created with
+   */
+  static ShaderReflection Reflect(const uint32_t* code, size_t size, const ValiumSpecialization& specialization = ValiumSpecialization());
+
+  /**
+   * Combines the interfaces of every stage of a pipeline. Bindings used by
+   * several stages get all of their stage flags, and the push constant
+   * blocks become one range visible to every stage using them.
+   */
+  static ShaderReflection Merge(const std::vector<const ShaderReflection*>& stages);
+};
@@ -13,15 +13,21 @@ struct ValiumRenderPass::impl {
    */
   VkDevice _device;
 
+  /**
+   * Layout the color attachment ends the pass in
+   */
+  VkImageLayout _finalLayout;
+
   /**
    * Initializes the render pass
    */
   void _CreateRenderPass();
 };
 
-ValiumRenderPass::ValiumRenderPass(VkDevice device) {
+ValiumRenderPass::ValiumRenderPass(VkDevice device, VkImageLayout finalLayout) {
   _impl = new impl();
   _impl->_device = device;
+  _impl->_finalLayout = finalLayout;
   _impl->_CreateRenderPass();
 }
 
@@ -41,7 +47,7 @@ void ValiumRenderPass::impl::_CreateRenderPass() {
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.finalLayout = _finalLayout;
 
 
   VkAttachmentReference colorAttachmentRef{};
@@ -53,12 +59,25 @@ void ValiumRenderPass::impl::_CreateRenderPass() {
   subpass.colorAttachmentCount = 1;
   subpass.pColorAttachments = &colorAttachmentRef;
 
+  // Hold the layout transition at the start of the pass until the image is
+  // actually available. The acquire semaphore is waited on at the color
+  // attachment output stage, so the transition has to happen there too.
+  VkSubpassDependency dependency{};
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass = 0;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.srcAccessMask = 0;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
   VkRenderPassCreateInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
   renderPassInfo.attachmentCount = 1;
   renderPassInfo.pAttachments = &colorAttachment;
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = 1;
+  renderPassInfo.pDependencies = &dependency;
 
   if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS) {
     throw std::runtime_error("failed to create render pass!");
@@ -68,3 +87,8 @@ void ValiumRenderPass::impl::_CreateRenderPass() {
 VkRenderPass ValiumRenderPass::GetVkRenderPass() const {
   return _impl->_renderPass;
 }
+
+uint64_t ValiumRenderPass::GetKey() const {
+  // The format and final layout are the only parts that vary
+  return (static_cast<uint64_t>(SWAPCHAIN_IMAGE_FORMAT) << 32) | static_cast<uint32_t>(_impl->_finalLayout);
+}
@@ -1,13 +1,22 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <cstdint>
 
 /**
  * Manages the framebuffer attachments used for rendering
  */
 class ValiumRenderPass {
 public:
-  ValiumRenderPass(VkDevice device);
+  /**
+   * Creates a single subpass renderpass with one color attachment
+   *
+   * @param[in] device Device to create the renderpass on
+   * @param[in] finalLayout Layout the color attachment is left in when the pass ends.
+   *                        Offscreen targets that are never presented should not use
+   *                        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR.
+   */
+  ValiumRenderPass(VkDevice device, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
   ~ValiumRenderPass();
 
   /**
@@ -15,6 +24,12 @@ public:
    */
   VkRenderPass GetVkRenderPass() const;
 
+  /**
+   * @returns a key that is the same for every renderpass created with the
+   *          same arguments, in this run and the next
+   */
+  uint64_t GetKey() const;
+
   /**
    * 
    */
@@ -0,0 +1,186 @@
+#include "valium_shader_cache.h"
+#include "valium_spirv_file.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/**
+ * What a shader file looked like when it was last loaded
+ */
+struct ShaderFileInfo {
+  /** Modification time of the file */
+  struct timespec mtime;
+
+  /** Size of the file in bytes */
+  off_t size;
+
+  /** Module created from the file's SPIR-V */
+  VkShaderModule module;
+};
+
+/**
+ * A shader module along with its reflected interface
+ */
+struct ShaderModuleInfo {
+  /** The shader module */
+  VkShaderModule module;
+
+  /** Hash of the module's SPIR-V */
+  uint64_t hash;
+
+  /** The module's SPIR-V, compared on a hash match so a collision can't share the module */
+  std::vector<uint32_t> code;
+
+  /** Interface read from the module's SPIR-V */
+  ShaderReflection reflection;
+};
+
+struct ValiumShaderCache::impl {
+  /** Device the modules are created on */
+  VkDevice _device;
+
+  /** Guards the maps */
+  std::mutex _mutex;
+
+  /** Every shader module created */
+  std::unordered_map<VkShaderModule, ShaderModuleInfo> _modules;
+
+  /** Modules keyed by the hash of their SPIR-V, several if hashes collide */
+  std::unordered_multimap<uint64_t, VkShaderModule> _hashes;
+
+  /** Files that have been loaded, keyed by path */
+  std::unordered_map<std::string, ShaderFileInfo> _files;
+
+  /**
+   * Returns the module for @a code, creating it if no identical SPIR-V has
+   * been seen. Must be called with @a _mutex held.
+   */
+  VkShaderModule _GetModule(uint64_t hash, const uint32_t* code, size_t size);
+};
+
+ValiumShaderCache::ValiumShaderCache(VkDevice device) {
+  _impl = new impl();
+  _impl->_device = device;
+}
+
+ValiumShaderCache::~ValiumShaderCache() {
+  for (auto& entry : _impl->_modules) {
+#ifdef SHOW_RESOURCE_ALLOCATION
+    std::cout << "Destroying shader module" << std::endl;
+#endif
+    vkDestroyShaderModule(_impl->_device, entry.second.module, nullptr);
+  }
+  delete _impl;
+}
+
+VkShaderModule ValiumShaderCache::GetModule(const std::string& path) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    throw std::runtime_error("failed to open file!");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_impl->_mutex);
+    auto file = _impl->_files.find(path);
+    if (file != _impl->_files.end() &&
+        file->second.size == info.st_size &&
+        file->second.mtime.tv_sec == info.st_mtim.tv_sec &&
+        file->second.mtime.tv_nsec == info.st_mtim.tv_nsec) {
+      return file->second.module;
+    }
+  }
+
+  // Map and hash outside the lock, other threads may be loading other files
+  ValiumSpirvFile spirv(path);
+  uint64_t hash = ValiumSpirvFile::Hash(spirv.GetCode(), spirv.GetSize());
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  VkShaderModule module = _impl->_GetModule(hash, spirv.GetCode(), spirv.GetSize());
+  _impl->_files[path] = {info.st_mtim, info.st_size, module};
+  return module;
+}
+
+VkShaderModule ValiumShaderCache::GetModule(const uint32_t* code, size_t size) {
+  uint64_t hash = ValiumSpirvFile::Hash(code, size);
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  return _impl->_GetModule(hash, code, size);
+}
+
+VkShaderModule ValiumShaderCache::impl::_GetModule(uint64_t hash, const uint32_t* code, size_t size) {
+  // Equal hashes don't prove equal code, compare the bytes too
+  auto candidates = _hashes.equal_range(hash);
+  for (auto candidate = candidates.first; candidate != candidates.second; ++candidate) {
+    const std::vector<uint32_t>& existing = _modules.at(candidate->second).code;
+    if (existing.size() * sizeof(uint32_t) == size && std::equal(existing.begin(), existing.end(), code)) {
+      return candidate->second;
+    }
+  }
+
+  // Reflect first, SPIR-V it can't make sense of never becomes a module
+  ShaderReflection reflection = ValiumReflection::Reflect(code, size);
+
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = size;
+  createInfo.pCode = code;
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating shader module" << std::endl;
+#endif
+  VkShaderModule module;
+  if (vkCreateShaderModule(_device, &createInfo, nullptr, &module) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create shader module!");
+  }
+
+  _modules[module] = {module, hash, std::vector<uint32_t>(code, code + size / sizeof(uint32_t)), reflection};
+  _hashes.emplace(hash, module);
+  return module;
+}
+
+const ShaderReflection& ValiumShaderCache::GetReflection(VkShaderModule module) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto info = _impl->_modules.find(module);
+  if (info == _impl->_modules.end()) {
+    throw std::runtime_error("shader module is not from this cache!");
+  }
+  // Entries are never removed, so the reference stays valid
+  return info->second.reflection;
+}
+
+ShaderReflection ValiumShaderCache::GetReflection(VkShaderModule module, const ValiumSpecialization& specialization) {
+  std::vector<uint32_t> code;
+  {
+    std::lock_guard<std::mutex> lock(_impl->_mutex);
+    auto info = _impl->_modules.find(module);
+    if (info == _impl->_modules.end()) {
+      throw std::runtime_error("shader module is not from this cache!");
+    }
+    if (specialization.empty()) {
+      return info->second.reflection;
+    }
+    code = info->second.code;
+  }
+  // Reflect outside the lock, the code is a copy
+  return ValiumReflection::Reflect(code.data(), code.size() * sizeof(uint32_t), specialization);
+}
+
+uint64_t ValiumShaderCache::GetHash(VkShaderModule module) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto info = _impl->_modules.find(module);
+  if (info == _impl->_modules.end()) {
+    throw std::runtime_error("shader module is not from this cache!");
+  }
+  return info->second.hash;
+}
+
+size_t ValiumShaderCache::GetModuleCount() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  return _impl->_modules.size();
+}
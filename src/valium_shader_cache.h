@@ -0,0 +1,76 @@
+#pragma once
+
+#include "valium_reflection.h"
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+
+/**
+ * Device wide cache of shader modules, keyed by a hash of their SPIR-V.
+ * A hash match is only a hit if the SPIR-V is identical too.
+ *
+ * A shader used by many pipelines is read and turned into a VkShaderModule
+ * once, and its SPIR-V is reflected at the same time. Files are also
+ * remembered by path, so asking for an unchanged file again doesn't even
+ * read it. The cache owns every module it returns and destroys them when
+ * it is destroyed. Safe to use from several threads.
+ */
+class ValiumShaderCache
+{
+ public:
+  /**
+   * @param[in] device Device to create shader modules on
+   */
+  ValiumShaderCache(VkDevice device);
+
+  /**
+   * Destroys every cached shader module
+   */
+  ~ValiumShaderCache();
+
+  /**
+   * Returns the module for a compiled shader file, loading it if the file
+   * is new or has been modified since it was last loaded
+   *
+   * @param[in] path Path to the SPIR-V file
+   */
+  VkShaderModule GetModule(const std::string& path);
+
+  /**
+   * Returns the module for SPIR-V already in memory
+   *
+   * @param[in] code SPIR-V words
+   * @param[in] size Size of @a code in bytes
+   */
+  VkShaderModule GetModule(const uint32_t* code, size_t size);
+
+  /**
+   * @returns the interface reflected from the module's SPIR-V
+   * @param[in] module A module returned by GetModule()
+   */
+  const ShaderReflection& GetReflection(VkShaderModule module);
+
+  /**
+   * Reflects the module again with specialization constants applied, for
+   * constants that size descriptor or uniform block arrays
+   *
+   * @param[in] module A module returned by GetModule()
+   * @param[in] specialization Constants the pipeline will be created with
+   */
+  ShaderReflection GetReflection(VkShaderModule module, const ValiumSpecialization& specialization);
+
+  /**
+   * @returns the hash of the module's SPIR-V, the same in every run
+   * @param[in] module A module returned by GetModule()
+   */
+  uint64_t GetHash(VkShaderModule module);
+
+  /**
+   * @returns the number of distinct shader modules created
+   */
+  size_t GetModuleCount();
+
+ private:
+  struct impl;
+  impl* _impl;
+};
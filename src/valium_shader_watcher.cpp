@@ -0,0 +1,156 @@
+#include "valium_shader_watcher.h"
+#include <thread>
+#include <mutex>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <iostream>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+struct ValiumShaderWatcher::impl {
+  /** Called when a watched file changes */
+  std::function<void(const std::string&)> _onChanged;
+
+  /** Guards @a _directories */
+  std::mutex _mutex;
+
+  /** Watched files keyed by their directory's watch descriptor, then by file name */
+  std::map<int, std::map<std::string, std::string>> _directories;
+
+  /** Watch descriptor of each watched directory */
+  std::map<std::string, int> _watches;
+
+  /** inotify instance, -1 when unsupported */
+  int _inotify = -1;
+
+  /** Written to by the destructor to wake the thread up */
+  int _stopEvent = -1;
+
+  /** Thread reading inotify events */
+  std::thread _thread;
+
+  /**
+   * Body of the watcher thread
+   */
+  void _WatchLoop();
+
+  /**
+   * Reports every watched file named in the pending events
+   */
+  void _ReadEvents();
+};
+
+ValiumShaderWatcher::ValiumShaderWatcher(std::function<void(const std::string&)> onChanged) {
+  _impl = new impl();
+  _impl->_onChanged = onChanged;
+#ifdef __linux__
+  _impl->_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  _impl->_stopEvent = eventfd(0, EFD_CLOEXEC);
+  if (_impl->_inotify < 0 || _impl->_stopEvent < 0) {
+    if (_impl->_inotify >= 0) close(_impl->_inotify);
+    if (_impl->_stopEvent >= 0) close(_impl->_stopEvent);
+    delete _impl;
+    throw std::runtime_error("failed to create shader watcher!");
+  }
+  _impl->_thread = std::thread(&impl::_WatchLoop, _impl);
+#else
+  std::cerr << "Shader hot reload is only supported on Linux" << std::endl;
+#endif
+}
+
+ValiumShaderWatcher::~ValiumShaderWatcher() {
+#ifdef __linux__
+  uint64_t stop = 1;
+  if (write(_impl->_stopEvent, &stop, sizeof(stop)) < 0) {
+    std::cerr << "failed to stop shader watcher" << std::endl;
+  }
+  _impl->_thread.join();
+  close(_impl->_inotify);
+  close(_impl->_stopEvent);
+#endif
+  delete _impl;
+}
+
+void ValiumShaderWatcher::AddFile(const std::string& path) {
+#ifdef __linux__
+  size_t slash = path.find_last_of('/');
+  std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  auto watch = _impl->_watches.find(directory);
+  int wd;
+  if (watch != _impl->_watches.end()) {
+    wd = watch->second;
+  } else {
+    wd = inotify_add_watch(_impl->_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+      throw std::runtime_error("failed to watch shader directory!");
+    }
+    _impl->_watches[directory] = wd;
+  }
+  _impl->_directories[wd][name] = path;
+#else
+  (void) path;
+#endif
+}
+
+void ValiumShaderWatcher::impl::_WatchLoop() {
+#ifdef __linux__
+  struct pollfd fds[2] = {
+    {_inotify, POLLIN, 0},
+    {_stopEvent, POLLIN, 0}
+  };
+
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      continue;
+    }
+    if (fds[1].revents & POLLIN) {
+      return;
+    }
+    if (fds[0].revents & POLLIN) {
+      _ReadEvents();
+    }
+  }
+#endif
+}
+
+void ValiumShaderWatcher::impl::_ReadEvents() {
+#ifdef __linux__
+  alignas(struct inotify_event) char buffer[4096 + sizeof(struct inotify_event) + NAME_MAX + 1];
+
+  // A single save often produces several events, report each file once
+  std::set<std::string> changed;
+  ssize_t length;
+  while ((length = read(_inotify, buffer, sizeof(buffer))) > 0) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (char* ptr = buffer; ptr < buffer + length; ) {
+      const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+      ptr += sizeof(struct inotify_event) + event->len;
+      if (event->len == 0) {
+        continue;
+      }
+
+      auto directory = _directories.find(event->wd);
+      if (directory == _directories.end()) {
+        continue;
+      }
+      auto file = directory->second.find(event->name);
+      if (file != directory->second.end()) {
+        changed.insert(file->second);
+      }
+    }
+  }
+
+  for (const std::string& path : changed) {
+    _onChanged(path);
+  }
+#endif
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+/**
+ * Watches shader files for changes on a background thread.
+ *
+ * The directories holding the files are watched instead of the files
+ * themselves, since most editors and glslc replace a file rather than
+ * write to it in place. Only supported on Linux, where it uses inotify.
+ * On other platforms files can be added but changes are never reported.
+ */
+class ValiumShaderWatcher
+{
+ public:
+  /**
+   * Starts the watcher thread
+   *
+   * @param[in] onChanged Called with the path of a watched file after it
+   *                      changes. Runs on the watcher thread.
+   */
+  ValiumShaderWatcher(std::function<void(const std::string&)> onChanged);
+
+  /**
+   * Stops and joins the watcher thread
+   */
+  ~ValiumShaderWatcher();
+
+  /**
+   * Starts reporting changes to @a path
+   *
+   * @param[in] path Path to the file, as it will be passed to the callback
+   */
+  void AddFile(const std::string& path);
+
+ private:
+  struct impl;
+  impl* _impl;
+};
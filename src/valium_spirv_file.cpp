@@ -0,0 +1,76 @@
+#include "valium_spirv_file.h"
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/** First word of every SPIR-V module */
+#define SPIRV_MAGIC 0x07230203u
+
+struct ValiumSpirvFile::impl {
+  /** Start of the mapping */
+  void* _data = MAP_FAILED;
+
+  /** Length of the mapping in bytes */
+  size_t _size = 0;
+};
+
+ValiumSpirvFile::ValiumSpirvFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open file!");
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("failed to stat shader file!");
+  }
+
+  size_t size = static_cast<size_t>(info.st_size);
+  if (size < sizeof(uint32_t) || size % sizeof(uint32_t) != 0) {
+    close(fd);
+    throw std::runtime_error("shader file is not valid SPIR-V!");
+  }
+
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("failed to map shader file!");
+  }
+
+  if (*static_cast<const uint32_t*>(data) != SPIRV_MAGIC) {
+    munmap(data, size);
+    throw std::runtime_error("shader file is not valid SPIR-V!");
+  }
+
+  _impl = new impl();
+  _impl->_data = data;
+  _impl->_size = size;
+}
+
+ValiumSpirvFile::~ValiumSpirvFile() {
+  munmap(_impl->_data, _impl->_size);
+  delete _impl;
+}
+
+const uint32_t* ValiumSpirvFile::GetCode() const {
+  return static_cast<const uint32_t*>(_impl->_data);
+}
+
+size_t ValiumSpirvFile::GetSize() const {
+  return _impl->_size;
+}
+
+// static
+uint64_t ValiumSpirvFile::Hash(const uint32_t* code, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(code);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
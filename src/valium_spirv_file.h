@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * A compiled SPIR-V shader mapped read-only into memory.
+ *
+ * The file is never copied, its pages are handed straight to
+ * vkCreateShaderModule. mmap returns page aligned memory, so the words are
+ * always aligned the way pCode requires.
+ */
+class ValiumSpirvFile
+{
+ public:
+  /**
+   * Maps @a path and checks that it looks like SPIR-V
+   *
+   * @param[in] path Path to the compiled shader
+   */
+  ValiumSpirvFile(const std::string& path);
+
+  /**
+   * Unmaps the file
+   */
+  ~ValiumSpirvFile();
+
+  ValiumSpirvFile(const ValiumSpirvFile&) = delete;
+  ValiumSpirvFile& operator=(const ValiumSpirvFile&) = delete;
+
+  /**
+   * @returns the SPIR-V words, valid until this object is destroyed
+   */
+  const uint32_t* GetCode() const;
+
+  /**
+   * @returns the size of the SPIR-V in bytes, always a multiple of 4
+   */
+  size_t GetSize() const;
+
+  /**
+   * Hashes SPIR-V with 64 bit FNV-1a, used to find identical shaders
+   *
+   * @param[in] code SPIR-V words
+   * @param[in] size Size of @a code in bytes
+   */
+  static uint64_t Hash(const uint32_t* code, size_t size);
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <algorithm>
 #include <memory>
+#include <limits>
 
 /**
  * Queries for available presentation modes
@@ -20,6 +21,11 @@ static std::vector<VkSurfaceFormatKHR> GetSurfaceFormatDetails(VkPhysicalDevice
  */
 static VkSurfaceCapabilitiesKHR GetCapabilities(VkPhysicalDevice device, VkSurfaceKHR surface);
 
+/**
+ * Picks the best available present mode for the given policy
+ */
+static VkPresentModeKHR ChoosePresentMode(const std::vector<VkPresentModeKHR>& modes, ValiumPresentPolicy policy);
+
 /**
  * Checks that the most common color format is available
  */
@@ -35,8 +41,20 @@ struct ValiumSwapchain::ValiumSwapchainImpl {
   /** Surface that will be used for queries */
   VkSurfaceKHR surface;
 
-  /** Indices to pass through to the swapchain */
-  uint32_t queueFamilyIndices[2];
+  /** Families that render into and present the images */
+  QueueFamilyIndices indices;
+
+  /**
+   * Pool on the present family for @a acquireBuffers.
+   * Only created when rendering and presenting use different families.
+   */
+  VkCommandPool ownershipPool = VK_NULL_HANDLE;
+
+  /** Per image, acquires the image on the present family before it is presented */
+  std::vector<VkCommandBuffer> acquireBuffers;
+
+  /** Per image, signaled when @a acquireBuffers has run, presentation waits on it */
+  std::vector<VkSemaphore> acquireSemaphores;
 
   /** Holds handles to images in the swapChain */
   std::vector<VkImage> swapChainImages;
@@ -56,6 +74,15 @@ struct ValiumSwapchain::ValiumSwapchainImpl {
   /** Format for images stored on the swapchain. */
   VkFormat imageFormat = SWAPCHAIN_IMAGE_FORMAT;
 
+  /** Present mode chosen when the swapchain was created */
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+  /** Policy given to InitializeSwapchain(), reused when the swapchain is recreated */
+  ValiumPresentPolicy policy = ValiumPresentPolicy::PowerSaving;
+
+  /** Renderpass the framebuffers were created for, reused when the swapchain is recreated */
+  const ValiumRenderPass* renderPass = nullptr;
+
   ValiumSwapchainImpl(VkPhysicalDevice device, VkSurfaceKHR surface, VkDevice logicalDevice) : device{device}, surface{surface}, logicalDevice(logicalDevice) {}
 
   /**
@@ -66,19 +93,54 @@ struct ValiumSwapchain::ValiumSwapchainImpl {
    */
   VkExtent2D GetExtent(uint32_t width, uint32_t height);
 
+  /**
+   * Creates swapChain with the given resolution
+   *
+   * @param[in] width Window width
+   * @param[in] height Window height
+   * @param[in] oldSwapchain Swapchain being replaced, or VK_NULL_HANDLE
+   */
+  void CreateSwapchain(uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain);
+
+  /**
+   * Destroys the framebuffers and views for the current swapchain images
+   */
+  void DestroyImageResources();
+
   /**
    * Returns the number of images to include in the swapchain
+   *
+   * @param[in] mode The present mode the swapchain will use
    */
-  uint32_t GetSwapchainImageCount();
+  uint32_t GetSwapchainImageCount(VkPresentModeKHR mode);
 
   /**
-   * Determines if the imageSharing mode should be concurrent or exclusive and
-   * sets that information in the given createinfo.
+   * Sets exclusive sharing in the given createinfo. Concurrent sharing can
+   * disable framebuffer compression, so when rendering and presenting use
+   * different families the images are handed over with ownership barriers.
    *
    * @param[out] createInfo Swapchain creation struct to set imageSharingMode values into.
    */
   void SetImageSharingMode(VkSwapchainCreateInfoKHR &createInfo);
 
+  /**
+   * Records the present family's acquire of each image.
+   * Does nothing unless the present family is split from graphics.
+   * @note Call after LoadImageHandles()
+   */
+  void CreateOwnershipTransfers();
+
+  /**
+   * Frees what CreateOwnershipTransfers() created for the current images
+   */
+  void DestroyOwnershipTransfers();
+
+  /**
+   * Fills in the ownership transfer barrier of image @a index from the
+   * graphics to the present family. Access and stage masks are left to the caller.
+   */
+  VkImageMemoryBarrier GetOwnershipBarrier(uint32_t index);
+
   /**
    * Gets image handles from the swapchain after its creation.
    * @note Call after InitializeSwapchain()
@@ -130,6 +192,29 @@ static VkSurfaceCapabilitiesKHR GetCapabilities(VkPhysicalDevice device, VkSurfa
   return capabilities;
 }
 
+static VkPresentModeKHR ChoosePresentMode(const std::vector<VkPresentModeKHR>& modes, ValiumPresentPolicy policy) {
+  std::vector<VkPresentModeKHR> preferred;
+  switch (policy) {
+  case ValiumPresentPolicy::LowLatency:
+    preferred = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+    break;
+  case ValiumPresentPolicy::MaxThroughput:
+    preferred = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+    break;
+  case ValiumPresentPolicy::PowerSaving:
+    break;
+  }
+
+  for (auto mode : preferred) {
+    if (std::find(modes.begin(), modes.end(), mode) != modes.end()) {
+      return mode;
+    }
+  }
+
+  // FIFO is the only mode the spec requires to be available
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
 static bool SupportsBGRA_SRGB_Nonlinear(VkPhysicalDevice device, VkSurfaceKHR surface) {
   std::vector<VkSurfaceFormatKHR> availableFormats = GetSurfaceFormatDetails(device, surface);
   for (const auto& availableFormat : availableFormats) {
@@ -163,11 +248,12 @@ ValiumSwapchain::ValiumSwapchain(VkPhysicalDevice device, VkSurfaceKHR surface,
 }
 
 ValiumSwapchain::~ValiumSwapchain() {
-  for (auto buf : _impl->frameBuffers) {
+  _impl->DestroyImageResources();
+  if (_impl->ownershipPool != VK_NULL_HANDLE) {
 #ifdef SHOW_RESOURCE_ALLOCATION
-    std::cout << "Destroying framebuffer" << std::endl;
+    std::cout << "Destroying present ownership command pool" << std::endl;
 #endif
-    vkDestroyFramebuffer(_impl->logicalDevice, buf, nullptr);
+    vkDestroyCommandPool(_impl->logicalDevice, _impl->ownershipPool, nullptr);
   }
 
   if (_impl->swapChain != VK_NULL_HANDLE) {
@@ -188,63 +274,189 @@ bool ValiumSwapchain::SupportsDrawing(VkPhysicalDevice device, VkSurfaceKHR surf
   return has_modes && has_desired_format;
 }
 
-void ValiumSwapchain::InitializeSwapchain(uint32_t width, uint32_t height) {
+void ValiumSwapchain::InitializeSwapchain(uint32_t width, uint32_t height, ValiumPresentPolicy policy) {
+  _impl->policy = policy;
+  _impl->CreateSwapchain(width, height, VK_NULL_HANDLE);
+  _impl->LoadImageHandles();
+  _impl->CreateOwnershipTransfers();
+}
+
+void ValiumSwapchain::Recreate(uint32_t width, uint32_t height) {
+  // The views and framebuffers belong to the old images, so they can't be reused
+  _impl->DestroyImageResources();
+
+  // Handing the old swapchain to the new one lets the presentation engine
+  // reuse its resources and finish showing any images still queued on it.
+  VkSwapchainKHR oldSwapchain = _impl->swapChain;
+  _impl->CreateSwapchain(width, height, oldSwapchain);
+  vkDestroySwapchainKHR(_impl->logicalDevice, oldSwapchain, nullptr);
+
+  _impl->LoadImageHandles();
+  _impl->CreateOwnershipTransfers();
+  if (_impl->renderPass != nullptr) {
+    _impl->InitializeFramebuffers(_impl->renderPass);
+  }
+}
+
+void ValiumSwapchain::ValiumSwapchainImpl::CreateSwapchain(uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain) {
   VkSwapchainCreateInfoKHR createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-  createInfo.surface = _impl->surface;
+  createInfo.surface = surface;
+
+  presentMode = ChoosePresentMode(GetPresentationModes(device, surface), policy);
 
-  uint32_t imageCount = _impl->GetSwapchainImageCount();
+  uint32_t imageCount = GetSwapchainImageCount(presentMode);
   createInfo.minImageCount = imageCount;
   
   // SupportsDrawing should have been called first to confirm this support
   createInfo.imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
   createInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
   
-  VkExtent2D extent = _impl->GetExtent(width, height);
+  extent = GetExtent(width, height);
   createInfo.imageExtent = extent;
-  _impl->extent = extent;
   createInfo.imageArrayLayers = 1;
   createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-  _impl->SetImageSharingMode(createInfo);
+  SetImageSharingMode(createInfo);
 
-  auto capabilities = GetCapabilities(_impl->device, _impl->surface);
+  auto capabilities = GetCapabilities(device, surface);
   createInfo.preTransform = capabilities.currentTransform;
 
   createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
-  createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  createInfo.presentMode = presentMode;
   // Don't render pixels covered by other windows by setting clipped = VK_TRUE
   createInfo.clipped = VK_TRUE;
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  createInfo.oldSwapchain = oldSwapchain;
 
-  std::cout << "Creating the swapchain." << std::endl;
-  if (vkCreateSwapchainKHR(_impl->logicalDevice, &createInfo, nullptr, &_impl->swapChain) != VK_SUCCESS) {
+  std::cout << "Creating the swapchain with present mode " << presentMode << " and " << imageCount << " images." << std::endl;
+  if (vkCreateSwapchainKHR(logicalDevice, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
     throw std::runtime_error("failed to create swap chain!");
   }
-  _impl->LoadImageHandles();
+}
+
+void ValiumSwapchain::ValiumSwapchainImpl::DestroyImageResources() {
+  for (auto buf : frameBuffers) {
+#ifdef SHOW_RESOURCE_ALLOCATION
+    std::cout << "Destroying framebuffer" << std::endl;
+#endif
+    vkDestroyFramebuffer(logicalDevice, buf, nullptr);
+  }
+  frameBuffers.clear();
+  views.clear();
+  DestroyOwnershipTransfers();
+  swapChainImages.clear();
 }
 
 void ValiumSwapchain::ValiumSwapchainImpl::SetImageSharingMode(VkSwapchainCreateInfoKHR &createInfo) {
-  QueueFamilyIndices indices = ValiumQueue::GetQueueIndices(device, surface);
-  queueFamilyIndices[0] = indices.graphicsFamily.value();
-  queueFamilyIndices[1] = indices.presentFamily.value();
-
-  if (indices.graphicsFamily != indices.presentFamily) {
-    createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-    createInfo.queueFamilyIndexCount = 2;
-    createInfo.pQueueFamilyIndices = queueFamilyIndices;
-  } else {
-    createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.queueFamilyIndexCount = 0; // Optional
-    createInfo.pQueueFamilyIndices = nullptr; // Optional
+  indices = ValiumQueue::GetQueueIndices(device, surface);
+
+  createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  createInfo.queueFamilyIndexCount = 0; // Optional
+  createInfo.pQueueFamilyIndices = nullptr; // Optional
+}
+
+VkImageMemoryBarrier ValiumSwapchain::ValiumSwapchainImpl::GetOwnershipBarrier(uint32_t index) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  // The renderpass already left the image ready to present
+  barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.srcQueueFamilyIndex = indices.graphicsFamily.value();
+  barrier.dstQueueFamilyIndex = indices.presentFamily.value();
+  barrier.image = swapChainImages.at(index);
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  return barrier;
+}
+
+void ValiumSwapchain::ValiumSwapchainImpl::CreateOwnershipTransfers() {
+  if (!indices.isPresentSplit()) {
+    return;
+  }
+
+  if (ownershipPool == VK_NULL_HANDLE) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = indices.presentFamily.value();
+#ifdef SHOW_RESOURCE_ALLOCATION
+    std::cout << "Creating present ownership command pool" << std::endl;
+#endif
+    if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &ownershipPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create present command pool!");
+    }
+  }
+
+  // The images never change, so each acquire is recorded once per swapchain
+  acquireBuffers.resize(swapChainImages.size());
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = ownershipPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = static_cast<uint32_t>(acquireBuffers.size());
+  if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, acquireBuffers.data()) != VK_SUCCESS) {
+    acquireBuffers.clear();
+    throw std::runtime_error("failed to allocate present command buffers!");
+  }
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (uint32_t i = 0; i < acquireBuffers.size(); i++) {
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create present semaphore!");
+    }
+    acquireSemaphores.push_back(semaphore);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    // Resubmitted every time its image comes around again
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    if (vkBeginCommandBuffer(acquireBuffers[i], &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording present command buffer!");
+    }
+
+    VkImageMemoryBarrier barrier = GetOwnershipBarrier(i);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(acquireBuffers[i], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (vkEndCommandBuffer(acquireBuffers[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record present command buffer!");
+    }
+  }
+}
+
+void ValiumSwapchain::ValiumSwapchainImpl::DestroyOwnershipTransfers() {
+  for (VkSemaphore semaphore : acquireSemaphores) {
+    vkDestroySemaphore(logicalDevice, semaphore, nullptr);
+  }
+  acquireSemaphores.clear();
+  if (!acquireBuffers.empty()) {
+    vkFreeCommandBuffers(logicalDevice, ownershipPool, static_cast<uint32_t>(acquireBuffers.size()), acquireBuffers.data());
+    acquireBuffers.clear();
   }
 }
 
-uint32_t ValiumSwapchain::ValiumSwapchainImpl::GetSwapchainImageCount() {
+uint32_t ValiumSwapchain::ValiumSwapchainImpl::GetSwapchainImageCount(VkPresentModeKHR mode) {
   VkSurfaceCapabilitiesKHR capabilities = GetCapabilities(device, surface);
 
-  uint32_t imageCount = capabilities.minImageCount + 1;
+  uint32_t imageCount;
+  if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+    // Mailbox needs one image on screen, one queued to replace it and one
+    // to render into, otherwise acquire blocks and the latency win is lost.
+    imageCount = std::max(capabilities.minImageCount + 1, 3u);
+  } else {
+    // One spare image so acquire doesn't wait on the presentation engine.
+    // FIFO already holds rendering to the refresh rate, so power saving
+    // keeps it too rather than stalling the render thread in acquire.
+    imageCount = capabilities.minImageCount + 1;
+  }
+
   if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount) {
     imageCount = capabilities.maxImageCount;
   }
@@ -268,11 +480,71 @@ VkExtent2D ValiumSwapchain::GetExtent() {
   return _impl->extent;
 }
 
+VkPresentModeKHR ValiumSwapchain::GetPresentMode() {
+  return _impl->presentMode;
+}
+
+uint32_t ValiumSwapchain::GetImageCount() {
+  return static_cast<uint32_t>(_impl->swapChainImages.size());
+}
+
+VkFramebuffer ValiumSwapchain::GetFramebuffer(uint32_t index) {
+  return _impl->frameBuffers.at(index);
+}
+
+VkResult ValiumSwapchain::AcquireNextImage(VkSemaphore signal, uint32_t* index) {
+  return vkAcquireNextImageKHR(_impl->logicalDevice, _impl->swapChain, std::numeric_limits<uint64_t>::max(), signal, VK_NULL_HANDLE, index);
+}
+
+void ValiumSwapchain::RecordRelease(VkCommandBuffer buffer, uint32_t index) {
+  if (!_impl->indices.isPresentSplit()) {
+    return;
+  }
+
+  VkImageMemoryBarrier barrier = _impl->GetOwnershipBarrier(index);
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                       0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+VkResult ValiumSwapchain::Present(ValiumQueueHandle* queue, VkSemaphore wait, uint32_t index) {
+  if (_impl->indices.isPresentSplit()) {
+    // Acquire the image on the present family before handing it to the
+    // presentation engine, which then waits on the acquire instead
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &wait;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_impl->acquireBuffers.at(index);
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_impl->acquireSemaphores.at(index);
+    if (queue->Submit(1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit present ownership transfer!");
+    }
+    wait = _impl->acquireSemaphores[index];
+  }
+
+  VkPresentInfoKHR presentInfo{};
+  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  presentInfo.waitSemaphoreCount = 1;
+  presentInfo.pWaitSemaphores = &wait;
+  presentInfo.swapchainCount = 1;
+  presentInfo.pSwapchains = &_impl->swapChain;
+  presentInfo.pImageIndices = &index;
+
+  return queue->Present(&presentInfo);
+}
+
 void ValiumSwapchain::InitializeFramebuffers(const ValiumRenderPass* renderPass) {
   _impl->InitializeFramebuffers(renderPass);
 }
 
 void ValiumSwapchain::ValiumSwapchainImpl::InitializeFramebuffers(const ValiumRenderPass* renderPass) {
+  this->renderPass = renderPass;
   frameBuffers.resize(views.size());
 
   for (size_t i = 0; i < views.size(); i++) {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "valium_renderpass.h"
+#include "valium_options.h"
+#include "valium_queue.h"
 #include <vulkan/vulkan.h>
 #include <vector>
 
@@ -52,13 +54,72 @@ class ValiumSwapchain
    *
    * @param[in] width Window width
    * @param[in] height Window height
+   * @param[in] policy Picks the present mode and the number of swapchain images
    */
-  void InitializeSwapchain(uint32_t width, uint32_t height);
+  void InitializeSwapchain(uint32_t width, uint32_t height, ValiumPresentPolicy policy = ValiumPresentPolicy::PowerSaving);
+
+  /**
+   * Replaces the swapchain with one of the given resolution, passing the
+   * current swapchain as oldSwapchain. Only the images, views and
+   * framebuffers are rebuilt. Framebuffers are recreated for the renderpass
+   * last given to InitializeFramebuffers().
+   *
+   * @note The device must be idle, none of the old images may be in use.
+   *
+   * @param[in] width New window width
+   * @param[in] height New window height
+   */
+  void Recreate(uint32_t width, uint32_t height);
+
+  /**
+   * @returns the present mode chosen by InitializeSwapchain()
+   */
+  VkPresentModeKHR GetPresentMode();
 
   /**
    * @returns the swapchain image's extent
    */
   VkExtent2D GetExtent();
+
+  /**
+   * @returns the number of images in the swapchain
+   */
+  uint32_t GetImageCount();
+
+  /**
+   * @returns the framebuffer for the swapchain image at @a index
+   * @note Call after InitializeFramebuffers()
+   */
+  VkFramebuffer GetFramebuffer(uint32_t index);
+
+  /**
+   * Acquires the next image to render to.
+   *
+   * @param[in] signal Semaphore signaled once the image may be rendered to
+   * @param[out] index Index of the acquired image
+   * @returns The result of vkAcquireNextImageKHR
+   */
+  VkResult AcquireNextImage(VkSemaphore signal, uint32_t* index);
+
+  /**
+   * Records the graphics family's release of image @a index to the present
+   * family. Does nothing when one family both renders and presents.
+   *
+   * @param[in] buffer Command buffer that rendered the image, outside a renderpass
+   * @param[in] index Index of the image
+   */
+  void RecordRelease(VkCommandBuffer buffer, uint32_t index);
+
+  /**
+   * Queues the image at @a index for presentation. When the present family
+   * is split from graphics, the image is first acquired on @a queue.
+   *
+   * @param[in] queue Queue to present with
+   * @param[in] wait Semaphore to wait on before presenting
+   * @param[in] index Index of the image to present
+   * @returns The result of vkQueuePresentKHR
+   */
+  VkResult Present(ValiumQueueHandle* queue, VkSemaphore wait, uint32_t index);
  private:
   struct ValiumSwapchainImpl;
   ValiumSwapchainImpl* _impl;
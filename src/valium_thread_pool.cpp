@@ -0,0 +1,103 @@
+#include "valium_thread_pool.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+struct ValiumThreadPool::impl {
+  /** Worker threads */
+  std::vector<std::thread> _workers;
+
+  /** Jobs waiting for a worker */
+  std::deque<std::function<void()>> _jobs;
+
+  /** Guards @a _jobs, @a _running and @a _stopping */
+  std::mutex _mutex;
+
+  /** Signaled when a job is queued or the pool is stopping */
+  std::condition_variable _jobAvailable;
+
+  /** Signaled when the last running job finishes and the queue is empty */
+  std::condition_variable _idle;
+
+  /** Number of jobs currently executing */
+  uint32_t _running = 0;
+
+  /** Set by the destructor to stop the workers once the queue drains */
+  bool _stopping = false;
+
+  /**
+   * Body of every worker thread
+   */
+  void _WorkerLoop();
+};
+
+ValiumThreadPool::ValiumThreadPool(uint32_t threadCount) {
+  _impl = new impl();
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (uint32_t i = 0; i < threadCount; i++) {
+    _impl->_workers.emplace_back(&impl::_WorkerLoop, _impl);
+  }
+}
+
+ValiumThreadPool::~ValiumThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_impl->_mutex);
+    _impl->_stopping = true;
+  }
+  _impl->_jobAvailable.notify_all();
+
+  for (auto& worker : _impl->_workers) {
+    worker.join();
+  }
+  delete _impl;
+}
+
+void ValiumThreadPool::impl::_WorkerLoop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _jobAvailable.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+      if (_jobs.empty()) {
+        // Stopping and nothing left to do
+        return;
+      }
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+      _running++;
+    }
+
+    job();
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _running--;
+      if (_running == 0 && _jobs.empty()) {
+        _idle.notify_all();
+      }
+    }
+  }
+}
+
+void ValiumThreadPool::Submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(_impl->_mutex);
+    _impl->_jobs.push_back(std::move(job));
+  }
+  _impl->_jobAvailable.notify_one();
+}
+
+void ValiumThreadPool::WaitIdle() {
+  std::unique_lock<std::mutex> lock(_impl->_mutex);
+  _impl->_idle.wait(lock, [this] { return _impl->_running == 0 && _impl->_jobs.empty(); });
+}
+
+uint32_t ValiumThreadPool::GetThreadCount() {
+  return static_cast<uint32_t>(_impl->_workers.size());
+}
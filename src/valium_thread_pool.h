@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <cstdint>
+
+/**
+ * A fixed set of worker threads that run submitted jobs in FIFO order.
+ *
+ * Used for work that can leave the render thread, e.g. compiling pipelines.
+ */
+class ValiumThreadPool
+{
+ public:
+  /**
+   * Starts the worker threads
+   *
+   * @param[in] threadCount Number of workers. 0 uses one per hardware thread.
+   */
+  ValiumThreadPool(uint32_t threadCount = 0);
+
+  /**
+   * Finishes every queued job, then joins the workers
+   */
+  ~ValiumThreadPool();
+
+  /**
+   * Queues @a job to run on a worker thread.
+   * Jobs must not throw, catch and report errors inside the job.
+   */
+  void Submit(std::function<void()> job);
+
+  /**
+   * Blocks until every job submitted so far has finished
+   */
+  void WaitIdle();
+
+  /**
+   * @returns the number of worker threads
+   */
+  uint32_t GetThreadCount();
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -0,0 +1,126 @@
+#include "valium_uniform_ring.h"
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+struct ValiumUniformRing::impl {
+  /** Host visible buffer holding every frame's region */
+  ValiumBuffer* _buffer = nullptr;
+
+  /** Persistent mapping of @a _buffer */
+  uint8_t* _mapped = nullptr;
+
+  /** minUniformBufferOffsetAlignment of the device */
+  VkDeviceSize _alignment = 1;
+
+  /** Bytes of each frame's region, a multiple of @a _alignment */
+  VkDeviceSize _frameSize = 0;
+
+  /** Largest range a descriptor of the ring may cover */
+  VkDeviceSize _maxRange = 0;
+
+  /** Start of the current frame's region in @a _buffer */
+  VkDeviceSize _frameBase = 0;
+
+  /** Bytes of the current frame's region handed out so far */
+  std::atomic<VkDeviceSize> _head{0};
+
+  /**
+   * Rounds @a size up to @a _alignment
+   */
+  VkDeviceSize _Align(VkDeviceSize size) const {
+    return (size + _alignment - 1) / _alignment * _alignment;
+  }
+};
+
+ValiumUniformRing::ValiumUniformRing(ValiumAllocator* allocator, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, VkDeviceSize frameSize) {
+  _impl = new impl();
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  _impl->_alignment = std::max<VkDeviceSize>(1, properties.limits.minUniformBufferOffsetAlignment);
+  _impl->_frameSize = _impl->_Align(frameSize);
+  _impl->_maxRange = std::min<VkDeviceSize>(properties.limits.maxUniformBufferRange, _impl->_frameSize);
+
+  // A descriptor's range is counted from the dynamic offset, so a slice at
+  // the end of the last region still needs a full range behind it
+  VkDeviceSize size = _impl->_frameSize * framesInFlight + _impl->_maxRange;
+  if (size > UINT32_MAX) {
+    delete _impl;
+    throw std::runtime_error("uniform ring is too large for dynamic offsets!");
+  }
+
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating uniform ring of " << _impl->_frameSize << " bytes per frame, aligned to "
+            << _impl->_alignment << std::endl;
+#endif
+  try {
+    _impl->_buffer = new ValiumBuffer(allocator, device, size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ValiumMemoryUsage::CpuToGpu);
+  } catch (...) {
+    delete _impl;
+    throw;
+  }
+  // Host visible memory is host coherent, writes need no flush
+  _impl->_mapped = static_cast<uint8_t*>(_impl->_buffer->GetMapped());
+}
+
+ValiumUniformRing::~ValiumUniformRing() {
+  delete _impl->_buffer;
+  delete _impl;
+}
+
+void ValiumUniformRing::BeginFrame(uint32_t frame) {
+  _impl->_frameBase = _impl->_frameSize * frame;
+  _impl->_head = 0;
+}
+
+ValiumUniformSlice ValiumUniformRing::Allocate(VkDeviceSize size) {
+  if (size > _impl->_maxRange) {
+    throw std::runtime_error("uniform data is larger than a uniform buffer range!");
+  }
+
+  // Rounding every slice up keeps the next one aligned without a retry loop
+  VkDeviceSize begin = _impl->_head.fetch_add(_impl->_Align(size));
+  if (begin + size > _impl->_frameSize) {
+    throw std::runtime_error("uniform ring frame is full!");
+  }
+
+  ValiumUniformSlice slice;
+  slice.offset = static_cast<uint32_t>(_impl->_frameBase + begin);
+  slice.data = _impl->_mapped + slice.offset;
+  return slice;
+}
+
+uint32_t ValiumUniformRing::Push(const void* data, VkDeviceSize size) {
+  ValiumUniformSlice slice = Allocate(size);
+  std::memcpy(slice.data, data, size);
+  return slice.offset;
+}
+
+VkDescriptorBufferInfo ValiumUniformRing::GetDescriptorInfo(VkDeviceSize range) const {
+  if (range > _impl->_maxRange) {
+    throw std::runtime_error("uniform block is larger than a uniform buffer range!");
+  }
+
+  VkDescriptorBufferInfo info{};
+  info.buffer = _impl->_buffer->GetVkBuffer();
+  info.offset = 0;
+  info.range = range;
+  return info;
+}
+
+VkBuffer ValiumUniformRing::GetVkBuffer() const {
+  return _impl->_buffer->GetVkBuffer();
+}
+
+VkDeviceSize ValiumUniformRing::GetAlignment() const {
+  return _impl->_alignment;
+}
+
+VkDeviceSize ValiumUniformRing::GetMaxRange() const {
+  return _impl->_maxRange;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "valium_buffer.h"
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+/**
+ * A range of the uniform ring written by the CPU for one draw
+ */
+struct ValiumUniformSlice {
+  /** Mapped pointer to write the uniform data to */
+  void* data = nullptr;
+
+  /** Dynamic offset to bind the ring's descriptor with */
+  uint32_t offset = 0;
+};
+
+/**
+ * Per frame uniform data in one persistently mapped buffer.
+ *
+ * The buffer is split into one region per frame in flight. Allocate()
+ * bumps a cursor through the current frame's region, so per draw data
+ * costs an atomic add and a memcpy instead of a buffer or a map per draw.
+ * Every slice starts on minUniformBufferOffsetAlignment and is bound with
+ * a dynamic offset into a single VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+ * descriptor, see GetDescriptorInfo().
+ *
+ * BeginFrame() rewinds the frame's region, which is only safe once the
+ * frame's fence has signaled. A region never grows, descriptors point at
+ * the buffer, so running out throws.
+ */
+class ValiumUniformRing
+{
+ public:
+  /**
+   * @param[in] allocator Allocator for the ring's buffer
+   * @param[in] physicalDevice Device to read the alignment limits from
+   * @param[in] device Device to create the buffer on
+   * @param[in] framesInFlight Number of frames that may be in flight at once
+   * @param[in] frameSize Bytes available to each frame
+   */
+  ValiumUniformRing(ValiumAllocator* allocator, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, VkDeviceSize frameSize);
+  ~ValiumUniformRing();
+
+  /**
+   * Rewinds @a frame's region and makes it the one Allocate() uses.
+   * Slices are handed out from frame 0 before the first call.
+   *
+   * @note The frame's previous submission must have completed, wait on its fence first.
+   */
+  void BeginFrame(uint32_t frame);
+
+  /**
+   * Reserves @a size bytes of the current frame's region. Safe to call
+   * from several threads, e.g. while recording secondary command buffers.
+   *
+   * @param[in] size Bytes to reserve, at most GetMaxRange()
+   */
+  ValiumUniformSlice Allocate(VkDeviceSize size);
+
+  /**
+   * Copies @a value into the current frame's region
+   *
+   * @returns the dynamic offset of the copy
+   */
+  template <typename T>
+  uint32_t Push(const T& value) {
+    return Push(&value, sizeof(T));
+  }
+
+  /**
+   * Copies @a size bytes of @a data into the current frame's region
+   *
+   * @returns the dynamic offset of the copy
+   */
+  uint32_t Push(const void* data, VkDeviceSize size);
+
+  /**
+   * Describes the ring for a dynamic uniform buffer descriptor. The
+   * descriptor starts at offset 0, the dynamic offset selects the slice.
+   *
+   * @param[in] range Size of the uniform block the shader reads
+   */
+  VkDescriptorBufferInfo GetDescriptorInfo(VkDeviceSize range) const;
+
+  /**
+   * @returns the ring's buffer
+   */
+  VkBuffer GetVkBuffer() const;
+
+  /**
+   * @returns the alignment every slice starts on
+   */
+  VkDeviceSize GetAlignment() const;
+
+  /**
+   * @returns the largest slice a descriptor can cover, maxUniformBufferRange
+   *          limited to the frame size
+   */
+  VkDeviceSize GetMaxRange() const;
+
+ private:
+  struct impl;
+  impl* _impl;
+};
@@ -0,0 +1,452 @@
+#include "valium_uploader.h"
+#include "app_config.h"
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#ifdef SHOW_RESOURCE_ALLOCATION
+#include <iostream>
+#endif
+
+/** Alignment of each upload in the staging buffer */
+#define UPLOAD_ALIGNMENT 16
+
+/** Copies recorded by EndFrame() for the transfer queue */
+#define UPLOAD_LANE_TRANSFER 0
+
+/** Copies recorded by RecordAcquire() on the graphics queue */
+#define UPLOAD_LANE_GRAPHICS 1
+
+/**
+ * One copy queued by Upload()
+ */
+struct ValiumUploadCopy {
+  /** Staging buffer the data was written into */
+  VkBuffer source;
+
+  /** Buffer the data is uploaded to */
+  VkBuffer destination;
+
+  /** Ranges of the copy in both buffers */
+  VkBufferCopy region;
+};
+
+/**
+ * Staging memory and queued copies of one queue in one frame. Each lane
+ * has its own staging buffers, so every buffer is only read by one family.
+ */
+struct ValiumUploadLane {
+  /** Host visible buffer uploads are written into */
+  ValiumBuffer* staging = nullptr;
+
+  /** Bytes of @a staging used this frame */
+  VkDeviceSize used = 0;
+
+  /** Staging buffers outgrown this frame, freed once the frame completes */
+  std::vector<ValiumBuffer*> retired;
+
+  /** Queued copies, in the order Upload() was called */
+  std::vector<ValiumUploadCopy> copies;
+};
+
+/**
+ * Staging memory and queued copies of one frame in flight
+ */
+struct ValiumUploadFrame {
+  /** Uploads for the transfer queue and for the graphics queue */
+  ValiumUploadLane lanes[2];
+
+  /** Command buffer the transfer lane's copies are recorded into */
+  VkCommandBuffer commands = VK_NULL_HANDLE;
+
+  /** Buffers handed to Retire(), destroyed once the frame completes */
+  std::vector<ValiumBuffer*> retired;
+
+  /** Buffers released by the last EndFrame(), still to be acquired by graphics */
+  std::set<VkBuffer> released;
+
+  /** Signaled by the transfer submission, only used with a separate transfer family */
+  VkSemaphore finished = VK_NULL_HANDLE;
+};
+
+struct ValiumUploader::impl {
+  /** Allocator for the staging buffers */
+  ValiumAllocator* _allocator;
+
+  /** Device the copies are recorded on */
+  VkDevice _device;
+
+  /** Pool for the per frame command buffers */
+  VkCommandPool _pool = VK_NULL_HANDLE;
+
+  /** Family the copies are submitted to */
+  uint32_t _transferFamily;
+
+  /** Family that uses the uploaded buffers */
+  uint32_t _graphicsFamily;
+
+  /** One entry per frame in flight */
+  std::vector<ValiumUploadFrame> _frames;
+
+  /** Frame uploads are currently collected for */
+  uint32_t _frame = 0;
+
+  /**
+   * Buffers the graphics family has acquired from the transfer family.
+   * Later uploads into them are copied on the graphics queue, which owns
+   * them and orders the copies after the frames still reading them.
+   */
+  std::set<VkBuffer> _owned;
+
+  /** Guards @a _frames, @a _frame and @a _owned */
+  std::mutex _mutex;
+
+  /**
+   * Builds the queue family ownership transfer of each buffer in @a buffers
+   * from the transfer to the graphics family. Access masks are left empty.
+   */
+  std::vector<VkBufferMemoryBarrier> _GetOwnershipBarriers(const std::set<VkBuffer>& buffers);
+
+  /**
+   * Replaces a lane's staging buffer with one of at least @a size bytes
+   */
+  void _GrowStaging(ValiumUploadLane& lane, VkDeviceSize size);
+
+  /**
+   * Records the copies queued in @a lane into @a buffer in queued order.
+   * A copy overlapping an earlier one is recorded behind a barrier, so
+   * the later upload always wins.
+   *
+   * @returns the buffers written
+   */
+  std::set<VkBuffer> _RecordCopies(VkCommandBuffer buffer, ValiumUploadLane& lane);
+};
+
+ValiumUploader::ValiumUploader(ValiumAllocator* allocator, VkDevice device, uint32_t transferFamily, uint32_t graphicsFamily, uint32_t framesInFlight) {
+  _impl = new impl();
+  _impl->_allocator = allocator;
+  _impl->_device = device;
+  _impl->_transferFamily = transferFamily;
+  _impl->_graphicsFamily = graphicsFamily;
+  _impl->_frames.resize(framesInFlight);
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  // Re-recorded every frame
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = transferFamily;
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Creating upload command pool" << std::endl;
+#endif
+  if (vkCreateCommandPool(device, &poolInfo, nullptr, &_impl->_pool) != VK_SUCCESS) {
+    delete _impl;
+    throw std::runtime_error("failed to create upload command pool!");
+  }
+
+  std::vector<VkCommandBuffer> buffers(framesInFlight);
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = _impl->_pool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = framesInFlight;
+  if (vkAllocateCommandBuffers(device, &allocInfo, buffers.data()) != VK_SUCCESS) {
+    vkDestroyCommandPool(device, _impl->_pool, nullptr);
+    delete _impl;
+    throw std::runtime_error("failed to allocate upload command buffers!");
+  }
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    _impl->_frames[i].commands = buffers[i];
+  }
+
+  if (transferFamily != graphicsFamily) {
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for (ValiumUploadFrame& frame : _impl->_frames) {
+      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.finished) != VK_SUCCESS) {
+        for (ValiumUploadFrame& created : _impl->_frames) {
+          vkDestroySemaphore(device, created.finished, nullptr);
+        }
+        vkDestroyCommandPool(device, _impl->_pool, nullptr);
+        delete _impl;
+        throw std::runtime_error("failed to create upload semaphore!");
+      }
+    }
+  }
+}
+
+ValiumUploader::~ValiumUploader() {
+  for (ValiumUploadFrame& frame : _impl->_frames) {
+    for (ValiumUploadLane& lane : frame.lanes) {
+      for (ValiumBuffer* buffer : lane.retired) {
+        delete buffer;
+      }
+      delete lane.staging;
+    }
+    for (ValiumBuffer* buffer : frame.retired) {
+      delete buffer;
+    }
+    vkDestroySemaphore(_impl->_device, frame.finished, nullptr);
+  }
+#ifdef SHOW_RESOURCE_ALLOCATION
+  std::cout << "Destroying upload command pool" << std::endl;
+#endif
+  vkDestroyCommandPool(_impl->_device, _impl->_pool, nullptr);
+  delete _impl;
+}
+
+void ValiumUploader::BeginFrame(uint32_t frame) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  _impl->_frame = frame;
+
+  // Copies queued for a frame that was never submitted, e.g. because the
+  // swapchain was out of date, still need their staging data
+  ValiumUploadFrame& current = _impl->_frames.at(frame);
+  for (ValiumUploadLane& lane : current.lanes) {
+    if (!lane.copies.empty()) {
+      return;
+    }
+  }
+
+  // The frame's last submission is done, so is everything it copied from
+  for (ValiumUploadLane& lane : current.lanes) {
+    for (ValiumBuffer* buffer : lane.retired) {
+      delete buffer;
+    }
+    lane.retired.clear();
+    lane.used = 0;
+  }
+  for (ValiumBuffer* buffer : current.retired) {
+    // The handle may be reused by a buffer graphics doesn't own yet
+    _impl->_owned.erase(buffer->GetVkBuffer());
+    delete buffer;
+  }
+  current.retired.clear();
+}
+
+void ValiumUploader::impl::_GrowStaging(ValiumUploadLane& lane, VkDeviceSize size) {
+  if (lane.staging != nullptr) {
+    // Copies already queued this frame still read from it
+    lane.retired.push_back(lane.staging);
+  }
+  lane.staging = new ValiumBuffer(_allocator, _device, std::max<VkDeviceSize>(size, UPLOAD_STAGING_SIZE), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, ValiumMemoryUsage::CpuToGpu);
+  lane.used = 0;
+}
+
+void ValiumUploader::Upload(ValiumBuffer* destination, const void* data, VkDeviceSize size, VkDeviceSize offset) {
+  if (size == 0) {
+    return;
+  }
+  if (offset + size > destination->GetSize()) {
+    throw std::runtime_error("upload is larger than its destination buffer!");
+  }
+
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  ValiumUploadFrame& current = _impl->_frames[_impl->_frame];
+  // Once graphics owns a buffer the transfer queue can't write it without
+  // taking it back, so the copy runs on the graphics queue instead
+  bool owned = _impl->_owned.count(destination->GetVkBuffer()) != 0;
+  ValiumUploadLane& lane = current.lanes[owned ? UPLOAD_LANE_GRAPHICS : UPLOAD_LANE_TRANSFER];
+
+  VkDeviceSize start = (lane.used + UPLOAD_ALIGNMENT - 1) & ~(VkDeviceSize) (UPLOAD_ALIGNMENT - 1);
+  if (lane.staging == nullptr || start + size > lane.staging->GetSize()) {
+    _impl->_GrowStaging(lane, size);
+    start = 0;
+  }
+
+  // Host coherent, no flush needed before the copy executes
+  memcpy(static_cast<char*>(lane.staging->GetMapped()) + start, data, size);
+  lane.used = start + size;
+
+  VkBufferCopy region{};
+  region.srcOffset = start;
+  region.dstOffset = offset;
+  region.size = size;
+  lane.copies.push_back({lane.staging->GetVkBuffer(), destination->GetVkBuffer(), region});
+}
+
+void ValiumUploader::Retire(ValiumBuffer* buffer) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  _impl->_frames[_impl->_frame].retired.push_back(buffer);
+}
+
+std::set<VkBuffer> ValiumUploader::impl::_RecordCopies(VkCommandBuffer buffer, ValiumUploadLane& lane) {
+  std::set<VkBuffer> written;
+  // Destination ranges written since the last barrier, those copies may run in any order
+  std::map<VkBuffer, std::vector<VkBufferCopy>> unordered;
+
+  // Consecutive copies between the same buffers go into one command
+  std::vector<VkBufferCopy> regions;
+  VkBuffer source = VK_NULL_HANDLE;
+  VkBuffer destination = VK_NULL_HANDLE;
+  auto flush = [&]() {
+    if (!regions.empty()) {
+      vkCmdCopyBuffer(buffer, source, destination, static_cast<uint32_t>(regions.size()), regions.data());
+      regions.clear();
+    }
+  };
+
+  for (const ValiumUploadCopy& copy : lane.copies) {
+    const std::vector<VkBufferCopy>& earlier = unordered[copy.destination];
+    bool overlaps = std::any_of(earlier.begin(), earlier.end(), [&](const VkBufferCopy& range) {
+      return range.dstOffset < copy.region.dstOffset + copy.region.size &&
+             copy.region.dstOffset < range.dstOffset + range.size;
+    });
+    if (overlaps) {
+      // Overlapping regions, even within one command, have no defined order
+      flush();
+      VkMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           0, 1, &barrier, 0, nullptr, 0, nullptr);
+      unordered.clear();
+    }
+
+    if (copy.source != source || copy.destination != destination) {
+      flush();
+      source = copy.source;
+      destination = copy.destination;
+    }
+    regions.push_back(copy.region);
+    unordered[copy.destination].push_back(copy.region);
+    written.insert(copy.destination);
+  }
+  flush();
+
+  lane.copies.clear();
+  return written;
+}
+
+VkCommandBuffer ValiumUploader::EndFrame() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  ValiumUploadFrame& current = _impl->_frames[_impl->_frame];
+  ValiumUploadLane& lane = current.lanes[UPLOAD_LANE_TRANSFER];
+  if (lane.copies.empty()) {
+    return VK_NULL_HANDLE;
+  }
+
+  VkCommandBuffer buffer = current.commands;
+  vkResetCommandBuffer(buffer, 0);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording upload command buffer!");
+  }
+
+  if (_impl->_transferFamily == _impl->_graphicsFamily) {
+    // Frames still in flight may read the ranges about to be overwritten,
+    // and earlier frames' copies may still be writing them
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  current.released = _impl->_RecordCopies(buffer, lane);
+
+  if (_impl->_transferFamily == _impl->_graphicsFamily) {
+    // Covers everything submitted after this on the same queue, i.e. the frame's draws
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+    current.released.clear();
+  } else {
+    // Exclusive buffers keep their contents across queue families only
+    // through a release here matched by an acquire on the graphics queue
+    std::vector<VkBufferMemoryBarrier> barriers = _impl->_GetOwnershipBarriers(current.released);
+    for (VkBufferMemoryBarrier& barrier : barriers) {
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+    // Acquired by this frame's graphics submission, later uploads go through graphics
+    _impl->_owned.insert(current.released.begin(), current.released.end());
+  }
+
+  if (vkEndCommandBuffer(buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record upload command buffer!");
+  }
+  return buffer;
+}
+
+std::vector<VkBufferMemoryBarrier> ValiumUploader::impl::_GetOwnershipBarriers(const std::set<VkBuffer>& buffers) {
+  std::vector<VkBufferMemoryBarrier> barriers;
+  for (VkBuffer buffer : buffers) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = _transferFamily;
+    barrier.dstQueueFamilyIndex = _graphicsFamily;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    barriers.push_back(barrier);
+  }
+  return barriers;
+}
+
+void ValiumUploader::RecordAcquire(VkCommandBuffer buffer) {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  ValiumUploadFrame& current = _impl->_frames[_impl->_frame];
+
+  if (!current.released.empty()) {
+    std::vector<VkBufferMemoryBarrier> barriers = _impl->_GetOwnershipBarriers(current.released);
+    for (VkBufferMemoryBarrier& barrier : barriers) {
+      barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    }
+    // Chained after the wait on GetSemaphore(), which happens at vertex input and compute
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+    current.released.clear();
+  }
+
+  ValiumUploadLane& lane = current.lanes[UPLOAD_LANE_GRAPHICS];
+  if (lane.copies.empty()) {
+    return;
+  }
+
+  // Same queue as the frames still reading the destinations, so a barrier
+  // orders the copies after them, and after the acquires above
+  VkMemoryBarrier before{};
+  before.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  before.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  before.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &before, 0, nullptr, 0, nullptr);
+
+  _impl->_RecordCopies(buffer, lane);
+
+  VkMemoryBarrier after{};
+  after.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  after.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  after.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 1, &after, 0, nullptr, 0, nullptr);
+}
+
+bool ValiumUploader::HasGraphicsWork() {
+  std::lock_guard<std::mutex> lock(_impl->_mutex);
+  const ValiumUploadFrame& current = _impl->_frames[_impl->_frame];
+  return !current.released.empty() || !current.lanes[UPLOAD_LANE_GRAPHICS].copies.empty();
+}
+
+bool ValiumUploader::IsAsync() const {
+  return _impl->_transferFamily != _impl->_graphicsFamily;
+}
+
+VkSemaphore ValiumUploader::GetSemaphore() const {
+  return _impl->_frames[_impl->_frame].finished;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "valium_buffer.h"
+#include <vulkan/vulkan.h>
+
+/**
+ * Fills device local buffers through host visible staging memory.
+ *
+ * Upload() copies the data into the current frame's staging buffer and
+ * queues a copy. EndFrame() records every copy queued during the frame into
+ * one command buffer, grouped into one vkCmdCopyBuffer per destination, so
+ * a frame's uploads cost a single batch in the frame's queue submission
+ * instead of a submit and wait per buffer.
+ *
+ * Each frame in flight has its own staging buffer, which is reused once
+ * BeginFrame() is called for that frame again.
+ *
+ * When the transfer family differs from the graphics family the copies run
+ * on the copy engine, in parallel with rendering. Ownership of each written
+ * buffer is released by the transfer queue and acquired by the graphics
+ * queue with RecordAcquire(), and the frame's graphics submission waits on
+ * GetSemaphore(). Buffers stay with the graphics family after that, so
+ * later uploads into them are copied by RecordAcquire() on the graphics
+ * queue, ordered after the frames still reading them.
+ */
+class ValiumUploader
+{
+ public:
+  /**
+   * @param[in] allocator Allocator for the staging buffers
+   * @param[in] device Device to record the copies on
+   * @param[in] transferFamily Family of the queue the copies are submitted to
+   * @param[in] graphicsFamily Family of the queue that uses the buffers
+   * @param[in] framesInFlight Number of frames that may be in flight at once
+   */
+  ValiumUploader(ValiumAllocator* allocator, VkDevice device, uint32_t transferFamily, uint32_t graphicsFamily, uint32_t framesInFlight);
+  ~ValiumUploader();
+
+  /**
+   * Starts collecting uploads for @a frame and reclaims its staging memory.
+   * Uploads made before the first call go to frame 0.
+   *
+   * @note The frame's previous submission must have completed, wait on its fence first.
+   */
+  void BeginFrame(uint32_t frame);
+
+  /**
+   * Queues a copy of @a data into @a destination. @a data may be released
+   * as soon as this returns. Copies run in the order they were queued, so
+   * the last upload to a range wins. Safe to call from several threads.
+   *
+   * @param[in] destination Buffer to write to
+   * @param[in] data Bytes to upload
+   * @param[in] size Number of bytes in @a data
+   * @param[in] offset Offset in @a destination to write at
+   */
+  void Upload(ValiumBuffer* destination, const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+
+  /**
+   * Records the frame's queued copies. On a shared family they are preceded
+   * by a barrier that waits for earlier frames' reads and copies of the
+   * destinations, and followed by a barrier that makes them visible to
+   * vertex input and to graphics and compute shaders later on the same
+   * queue. Otherwise they are followed by the release of each written
+   * buffer.
+   *
+   * @returns the command buffer to submit ahead of the frame's rendering,
+   *          or VK_NULL_HANDLE if nothing was uploaded this frame
+   */
+  VkCommandBuffer EndFrame();
+
+  /**
+   * Records the graphics queue's half of the ownership transfers for the
+   * buffers written by the last EndFrame(), then the frame's copies into
+   * buffers the graphics family already owns. Does nothing on a shared family.
+   *
+   * @param[in] buffer Graphics command buffer recording outside a renderpass
+   */
+  void RecordAcquire(VkCommandBuffer buffer);
+
+  /**
+   * Destroys @a buffer once the current frame has completed. Copies
+   * already queued into it are still recorded, so it can be replaced
+   * right after an Upload() into it.
+   *
+   * @param[in] buffer Buffer to destroy, ownership passes to the uploader
+   */
+  void Retire(ValiumBuffer* buffer);
+
+  /**
+   * @returns true if RecordAcquire() has anything to record this frame
+   */
+  bool HasGraphicsWork();
+
+  /**
+   * @returns true if the copies are submitted to a separate transfer queue
+   */
+  bool IsAsync() const;
+
+  /**
+   * Semaphore the current frame's transfer submission signals and its
+   * graphics submission waits on at VK_PIPELINE_STAGE_VERTEX_INPUT_BIT and
+   * VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT.
+   * VK_NULL_HANDLE on a shared family.
+   */
+  VkSemaphore GetSemaphore() const;
+
+ private:
+  struct impl;
+  impl* _impl;
+};
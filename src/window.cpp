@@ -7,18 +7,28 @@
 
 struct Window::impl {
   GLFWwindow* window = nullptr;
+  /** Set by the framebuffer size callback, cleared by WasResized() */
+  bool resized = false;
 };
 
+// static
+void Window::FramebufferResizeCallback(GLFWwindow* window, int /* width */, int /* height */) {
+  auto impl = reinterpret_cast<Window::impl*>(glfwGetWindowUserPointer(window));
+  impl->resized = true;
+}
+
 Window::Window(const char* title) {
   _impl = new impl();
   
   glfwInit();
   // Don't enable OpenGL API so we can use vulkan
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  // Don't make the window resizable for now.
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  // Resizing rebuilds the swapchain, see ValiumDevice::RecreateSwapchain()
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
   _impl->window = glfwCreateWindow(WIDTH, HEIGHT, title, nullptr, nullptr);
+  glfwSetWindowUserPointer(_impl->window, _impl);
+  glfwSetFramebufferSizeCallback(_impl->window, FramebufferResizeCallback);
 }
 
 Window::~Window() {
@@ -31,3 +41,9 @@ Window::~Window() {
 GLFWwindow* Window::GetWindow() {
   return _impl->window;
 }
+
+bool Window::WasResized() {
+  bool resized = _impl->resized;
+  _impl->resized = false;
+  return resized;
+}
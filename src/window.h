@@ -16,9 +16,19 @@ class Window
 
   GLFWwindow* GetWindow();
 
+  /**
+   * Returns true if the framebuffer was resized since the last call
+   */
+  bool WasResized();
+
  private:
   struct impl;
   struct impl* _impl;
+
+  /**
+   * Records that the framebuffer changed size so the swapchain can be rebuilt
+   */
+  static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
 };
 
 #endif